@@ -1,9 +1,6 @@
 #include "app.hpp"
 #include "models.hpp"
 
-#include "boost/algorithm/string.hpp"
-#include "boost/lexical_cast.hpp"
-#include "boost/range/algorithm.hpp"
 #include "fmt/core.h"
 #include "lyra/arg.hpp"
 #include "lyra/arguments.hpp"
@@ -11,101 +8,35 @@
 #include "lyra/lyra.hpp"
 #include "lyra/opt.hpp"
 
-#include <algorithm>
 #include <cstdlib>
 #include <iostream>
-#include <string_view>
+#include <map>
 #include <vector>
 
-std::string parseGPU(std::vector<int> &result_gpus, std::string_view gpuRange) {
-  // Yes, this stupid boilerplate code is needed just to parse
-  // two numbers and a dash in square brackets (like [1-4]).
-  // Yes, it`s dumb, as soon, as we could make one simple regex.
-  // But, first of all, regex is always a technical debt, learn to live without
-  // them. Secondly, I want to make user friendly cli with user friendly error
-  // messages. There are always a donkey: user or developer.
-  std::vector<int> gpus;
-  if (gpuRange.empty()) {
-    return "empty range";
-  }
-  if (gpuRange[0] != '[') {
-    return "invalid format: not [ on first place";
-  }
-  if (gpuRange.back() != ']') {
-    return "invalid format: not ] on the last place";
-  }
-
-  // Remove brackets, now we are working with range_str, not gpuRange
-  auto range_str = gpuRange.substr(1, gpuRange.size() - 2);
-
-  // split ranges by comma
-  std::vector<std::string> ranges;
-  boost::split(ranges, range_str, boost::is_any_of(","));
-
-  // now we are working on range(it is just one number or range like `1-4`)
-  for (const auto &range : ranges) {
-    bool is_number = false;
-    int gpu_number = -1;
-    try {
-      gpu_number = boost::lexical_cast<int>(range);
-      is_number = true;
-    } catch (boost::bad_lexical_cast &) {
-    }
-
-    // if it is just number then just push to back its value
-    if (is_number) {
-      gpus.emplace_back(gpu_number);
-      continue;
-    }
-
-    const auto dash = range.find('-');
-    if (dash == std::basic_string<char>::npos) {
-      return "dash is missed";
-    }
-    if (dash == 0) {
-      return "first number is missed or negative";
-    }
-
-    auto ls = range.substr(0, dash);
-    auto rs = range.substr(dash + 1);
-    int l = 0;
-    int r = 0;
-    try {
-      l = boost::lexical_cast<int>(ls);
-      r = boost::lexical_cast<int>(rs);
-    } catch (...) {
-      return fmt::format("can`t parse numbers: {} and {}", ls, rs);
-    }
-
-    if (r < l) {
-      return "right < left number";
-    }
-
-    const auto old_size = gpus.size();
-    gpus.resize(old_size + r - l + 1);
-    std::iota(std::next(gpus.begin(), (long)old_size), gpus.end(), l);
-  }
-
-  // make gpus unique
-  auto unique_gpus = boost::range::unique(gpus);
-
-  boost::range::copy(unique_gpus, std::back_inserter(result_gpus));
-
-  return "";
-}
-
 int main(int argc, char *argv[]) {
   using namespace crypto;
 
   std::string token;
   std::string url = "server.tonguys.com";
   std::string logLevel = "debug";
+  std::string compression = "responses";
   long factor = 64;
+  long long iterations = 1000000000000000;
+  long pollInterval = 10;
+  long poolSize = 2;
+  long taskTimeout = 10;
+  long hedgePercentile = 0;
+  bool independent = false;
+  bool multiShare = false;
+  bool subscribe = false;
   bool showHelp = false;
 
   auto currentDirectory = boost::filesystem::current_path();
   auto logPath = currentDirectory / "client.log";
   auto miner = currentDirectory / "pow-miner-cuda";
+  auto journal = currentDirectory / "answers.journal";
+  auto sessionDir = currentDirectory / "tls-sessions";
+  boost::filesystem::path config;
   std::string gpuRange = "[0-0]";
 
   auto cli =
@@ -114,7 +45,9 @@ int main(int argc, char *argv[]) {
           "Your token, get it using bot https://t.me/tonguys_pool_bot")
           .required() |
       lyra::opt(url, "url")["-u"]["--url"](
-          fmt::format("Server url (default to {})", url))
+          fmt::format("Server urls, comma separated: requests go to the "
+                      "fastest healthy one (default to {})",
+                      url))
           .optional() |
       lyra::opt(logLevel, "logLevel")["-l"]["--level"]("Log level")
           .optional()
@@ -125,9 +58,62 @@ int main(int argc, char *argv[]) {
           .optional() |
       lyra::opt(factor, "factor")["-F"]["--boost-factor"]("Boost factor")
           .optional() |
+      lyra::opt(iterations, "iterations")["-i"]["--max-iterations"](
+          "Upper bound of miner iterations, actual number is sized from the "
+          "time left to the task expiration and measured hash rate")
+          .optional() |
       lyra::opt(gpuRange, "gpuRange")["-G"]["--gpu-range"](
           "Devices range: [0-2,4,7-9] will use #0,#1,#2,#4,#7,#8,#9; "
           "[0,3] is #0,#3; [0] is #0")
+          .optional() |
+      lyra::opt(pollInterval, "pollInterval")["-P"]["--poll-interval"](
+          fmt::format("Seconds between task checks during a round, 0 to "
+                      "disable (default to {})",
+                      pollInterval))
+          .optional() |
+      lyra::opt(independent)["-I"]["--independent"](
+          "Run separate fetch/mine/submit loop for every GPU, so a share found "
+          "on one GPU doesn't restart others")
+          .optional() |
+      lyra::opt(multiShare)["-M"]["--multi-share"](
+          "Submit every unique answer found in a round, not only the first")
+          .optional() |
+      lyra::opt(journal, "journal")["-J"]["--journal"](
+          "Path to journal of found answers, unsent ones are resent on start")
+          .optional() |
+      lyra::opt(config, "config")["-C"]["--config"](
+          "Path to json config with boost-factor, gpu-range and miner. They "
+          "override command line and are reloaded on file change or SIGHUP")
+          .optional() |
+      lyra::opt(poolSize, "poolSize")["-p"]["--pool-size"](
+          fmt::format("Max number of kept-alive server connections (default "
+                      "to {})",
+                      poolSize))
+          .optional() |
+      lyra::opt(subscribe)["-S"]["--subscribe"](
+          "Keep a channel open for tasks pushed by the server, so task "
+          "changes are known at once, not on the next poll")
+          .optional() |
+      lyra::opt(taskTimeout, "taskTimeout")["-T"]["--task-timeout"](
+          fmt::format("Seconds given to get a task, retries included; "
+                      "answers are given time until their task expires "
+                      "(default to {})",
+                      taskTimeout))
+          .optional() |
+      lyra::opt(compression, "compression")["-Z"]["--compression"](
+          fmt::format("Compression of server exchanges: off, responses or "
+                      "all (answers too), comma separated url=mode entries "
+                      "set it for one server (default to {})",
+                      compression))
+          .optional() |
+      lyra::opt(sessionDir, "sessionDir")["-K"]["--session-dir"](
+          "Directory TLS sessions are saved to, so connections are resumed "
+          "after restart; empty to disable")
+          .optional() |
+      lyra::opt(hedgePercentile, "hedgePercentile")["-H"]["--hedge"](
+          "Task request slower than this percentile of recent ones is sent "
+          "once more and the first answer is taken, 0 to disable (default "
+          "to 0)")
           .optional();
 
   auto result = cli.parse({argc, argv});
@@ -142,18 +128,53 @@ int main(int argc, char *argv[]) {
     return 0;
   }
 
+  if (taskTimeout < 1) {
+    std::cerr << "Error: task timeout must be positive" << std::endl;
+    return 1;
+  }
+
+  if (hedgePercentile < 0 || hedgePercentile > 99) {
+    std::cerr << "Error: hedge percentile must be in [0, 99]" << std::endl;
+    return 1;
+  }
+
+  if (poolSize < 1) {
+    std::cerr << "Error: pool size must be positive" << std::endl;
+    return 1;
+  }
+
   std::vector<int> gpu;
-  std::string report = parseGPU(gpu, gpuRange);
+  std::string report = model::ParseGPU(gpu, gpuRange);
   if (!report.empty()) {
     std::cerr << "Error: gpu range parsing error: " << report << std::endl;
     return 1;
   }
 
-  const long long iterations = 1000000000000000;
+  std::vector<std::string> urls;
+  report = model::ParseUrls(urls, url);
+  if (!report.empty()) {
+    std::cerr << "Error: url parsing error: " << report << std::endl;
+    return 1;
+  }
+
+  std::map<std::string, model::Compression> compressions;
+  report = model::ParseCompression(compressions, compression, urls);
+  if (!report.empty()) {
+    std::cerr << "Error: compression parsing error: " << report << std::endl;
+    return 1;
+  }
+
   crypto::App app;
   return app.Run(crypto::model::Config(
-      model::Token = std::move(token), model::Url = std::move(url),
+      model::Token = std::move(token), model::Url = std::move(urls),
       model::LogLevel = logLevel, model::LogPath = logPath,
       model::MinerPath = std::move(miner), model::BoostFactor = factor,
-      model::GPU = std::move(gpu), model::Iterations = iterations));
+      model::GPU = std::move(gpu), model::Iterations = iterations,
+      model::PollInterval = pollInterval, model::Independent = independent,
+      model::MultiShare = multiShare, model::JournalPath = journal,
+      model::ConfigPath = config, model::PoolSize = poolSize,
+      model::Subscribe = subscribe, model::TaskTimeout = taskTimeout,
+      model::Compress = std::move(compressions),
+      model::SessionDir = sessionDir,
+      model::HedgePercentile = hedgePercentile));
 }
\ No newline at end of file
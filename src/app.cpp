@@ -1,18 +1,39 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstddef>
+#include <exception>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <variant>
 
 #include "app.hpp"
 
+#include "breakerClient.hpp"
+#include "hedgedClient.hpp"
 #include "client.hpp"
 #include "executor.hpp"
+#include "failoverClient.hpp"
 #include "httpClient.hpp"
+#include "journal.hpp"
 #include "mockClient.hpp"
+#include "poller.hpp"
+#include "prefetcher.hpp"
+#include "reactor.hpp"
+#include "retryClient.hpp"
+#include "scheduler.hpp"
+#include "subscriber.hpp"
+#include "submitter.hpp"
+#include "watcher.hpp"
 
 #include "boost/filesystem.hpp"
+#include "fmt/format.h"
 #include "nlohmann/json.hpp"
 #include "spdlog/common.h"
 #include "spdlog/sinks/rotating_file_sink.h"
@@ -23,15 +44,14 @@ namespace crypto {
 
 void printStatistic(std::optional<model::Statistic> st_opt) {
   try {
-    static int count = 0;
+    static std::atomic_int count = 0;
     if (!st_opt) {
       spdlog::warn("No statistic parsed");
       return;
     }
 
-    count++;
     auto st = st_opt.value();
-    st.count = count;
+    st.count = ++count;
     nlohmann::json j = st;
     spdlog::info("JSON STATISTIC: {}", j.dump());
   } catch (...) {
@@ -56,66 +76,416 @@ void configureLogger(const model::Config &cfg) {
   spdlog::set_default_logger(log);
 }
 
+model::TaskResponse App::next(Lane &lane) {
+  // hashrate is not lost to a network blip: the last task is mined until it
+  // expires, answers found meanwhile are held by submitter
+  auto fallback = [&lane](model::Err err) -> model::TaskResponse {
+    if (!lane.last || lane.last->expires.GetUnix() <= std::time(nullptr)) {
+      return err;
+    }
+    if (!lane.offline) {
+      spdlog::warn("Server is unavailable, mining the last known task");
+      lane.offline = true;
+    }
+    return lane.last.value();
+  };
+  if (breaker->Current() == BreakerClient::State::open) {
+    return fallback(model::Err{std::nullopt, model::Err::circuitOpen,
+                               "server is considered down"});
+  }
+
+  spdlog::debug("Request new task");
+  auto resp = lane.prefetcher->Next();
+  auto *task = std::get_if<model::Task>(&resp);
+  if (task == nullptr) {
+    return fallback(std::get<model::Err>(std::move(resp)));
+  }
+  if (lane.offline) {
+    spdlog::info("Server is reachable again");
+    lane.offline = false;
+  }
+  lane.last = *task;
+  submitter->Resend();
+  return resp;
+}
+
+int App::mine(Lane &lane) {
+  // failed task requests are repeated with growing pauses, only the server
+  // refusing the client for good stops it
+  constexpr std::chrono::milliseconds minPause = std::chrono::seconds(1);
+  constexpr std::chrono::milliseconds maxPause = std::chrono::seconds(8);
+  auto fatal = [](const model::Err &err) {
+    return err.code >= 400 && err.code < 500 && !Retryable(err);
+  };
+
+  auto pause = minPause;
+  while (running.load() && !lane.stopped.load()) {
+    auto resp = next(lane);
+    if (auto *err = std::get_if<model::Err>(&resp)) {
+      if (fatal(*err)) {
+        spdlog::critical("Can`t get new task from server: {}", *err);
+        return 1;
+      }
+      if (lane.offline || breaker->Current() != BreakerClient::State::closed) {
+        // nothing to mine until the server is back
+        spdlog::debug("Server is unavailable and there is no task to mine");
+      } else {
+        spdlog::warn("Can`t get new task: {}, next try in {}ms", *err,
+                     pause.count());
+      }
+      std::this_thread::sleep_for(pause);
+      pause = std::min(pause * 2, maxPause);
+      continue;
+    }
+    pause = minPause;
+    auto task = std::get<model::Task>(std::move(resp));
+    spdlog::debug("Got task: {}", task);
+
+    std::vector<int> gpu;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      gpu = lane.gpu;
+    }
+    auto scheduled = scheduler->Schedule(task, gpu);
+    if (!scheduled) {
+      // server should give a fresher task soon, don't hammer it meanwhile
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      continue;
+    }
+    auto &minerTask = scheduled.value();
+    spdlog::debug("Starting miner with task: {}", Dump(minerTask));
+    lane.prefetcher->Mined();
+
+    poller->Watch(task);
+    // next task is fetched right before this round ends
+    lane.prefetcher->Prefetch(minerTask.deadline);
+    if (!mining.exchange(true)) {
+      spdlog::info("First round started {}ms after start",
+                   std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - startedAt)
+                       .count());
+    }
+    // miners are not stopped between rounds: executor keeps them running if
+    // the next task is the same work
+    auto res = lane.exec->Run(minerTask);
+    if (!res.empty()) {
+      // prefetched task still has the seed we've just solved
+      lane.prefetcher->Solved(minerTask.seed);
+    }
+    for (auto &ok : res) {
+      spdlog::debug("Found answer: {}", Dump(ok));
+      printStatistic(ok.answer.statistic);
+      submitter->Submit(std::move(ok.answer));
+    }
+  }
+  return 0;
+}
+
+void App::addLane(std::vector<int> gpu) {
+  auto lane = std::make_unique<Lane>();
+  lane->gpu = std::move(gpu);
+  lane->exec = std::make_unique<Executor>(config.value(), *reactor, *scheduler);
+  lane->prefetcher =
+      std::make_unique<TaskPrefetcher>(*client, *reactor, *scheduler);
+  lanes.push_back(std::move(lane));
+}
+
+void App::startLane(Lane &lane) {
+  spdlog::info("Starting mining loop for GPU [{}]", fmt::join(lane.gpu, ", "));
+  lane.loop = std::async(std::launch::async, [this, &lane]() {
+    auto res = mine(lane);
+    // one failed loop stops the whole client, as it did before
+    if (res != 0) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed = true;
+        running.store(false);
+      }
+      cond.notify_all();
+      stopLanes();
+    }
+    return res;
+  });
+}
+
+void App::stopLanes() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto &lane : lanes) {
+    lane->exec->Stop();
+  }
+}
+
+void App::reload(const model::Reloadable &reloaded) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!running.load()) {
+    return;
+  }
+
+  auto &cfg = config.value();
+  if (reloaded.boostFactor) {
+    cfg.boostFactor = reloaded.boostFactor.value();
+  }
+  if (reloaded.miner) {
+    cfg.miner = reloaded.miner.value();
+  }
+  for (auto &lane : lanes) {
+    lane->exec->Reconfigure(cfg.boostFactor, cfg.miner);
+  }
+
+  if (!reloaded.gpu || reloaded.gpu.value() == cfg.gpu) {
+    return;
+  }
+  cfg.gpu = reloaded.gpu.value();
+  spdlog::info("GPU set changed to [{}]", fmt::join(cfg.gpu, ", "));
+
+  if (!cfg.independent) {
+    // round is interrupted to start new GPUs right away, miners of GPUs
+    // still in use keep working
+    auto &lane = *lanes.front();
+    lane.gpu = cfg.gpu;
+    lane.exec->Interrupt();
+    return;
+  }
+
+  // stopped lanes are dropped once their loops are over, so toggling a GPU
+  // doesn't pile up dead executors
+  auto finished = [](const std::unique_ptr<Lane> &lane) {
+    return lane->stopped.load() &&
+           lane->loop.wait_for(std::chrono::seconds(0)) ==
+               std::future_status::ready;
+  };
+  lanes.erase(std::remove_if(lanes.begin(), lanes.end(), finished),
+              lanes.end());
+
+  auto used = [&cfg](int gpu) {
+    return std::find(cfg.gpu.begin(), cfg.gpu.end(), gpu) != cfg.gpu.end();
+  };
+  std::vector<int> active;
+  for (auto &lane : lanes) {
+    if (lane->stopped.load()) {
+      continue;
+    }
+    auto gpu = lane->gpu.front();
+    if (!used(gpu)) {
+      spdlog::info("Stopping mining loop for GPU #{}", gpu);
+      lane->stopped.store(true);
+      lane->exec->Stop();
+      continue;
+    }
+    active.push_back(gpu);
+  }
+  for (auto gpu : cfg.gpu) {
+    if (std::find(active.begin(), active.end(), gpu) == active.end()) {
+      addLane({gpu});
+      startLane(*lanes.back());
+    }
+  }
+}
+
+int App::shutdown() {
+  if (watcher) {
+    watcher->Stop();
+  }
+  if (subscriber) {
+    subscriber->Stop();
+  }
+  if (poller) {
+    poller->Stop();
+  }
+  client->Stop();
+  if (hedged != nullptr) {
+    hedged->Stop();
+  }
+  stopLanes();
+
+  // nothing changes lanes anymore, as watcher and poller are stopped
+  int code = 0;
+  for (auto &lane : lanes) {
+    if (lane->loop.valid()) {
+      code = std::max(code, lane->loop.get());
+    }
+    // prefetchers refer to the client, which is going to be destroyed
+    lane->prefetcher.reset();
+  }
+  // executors wait for their miners handlers, so the reactor must be running
+  for (auto &lane : lanes) {
+    lane->exec.reset();
+  }
+  if (submitter) {
+    submitter->Stop();
+  }
+  // nothing is handled after this point, so the rest could be destroyed
+  reactor->Stop();
+
+  watcher.reset();
+  subscriber.reset();
+  poller.reset();
+  submitter.reset();
+  journal.reset();
+  breaker = nullptr;
+  hedged = nullptr;
+  client.reset();
+  return code;
+}
+
 int App::Run(const model::Config &cfg) {
   if (running.load()) {
     spdlog::critical("Starting already running App");
     throw std::runtime_error("Already started");
   }
   running.store(true);
+  startedAt = std::chrono::steady_clock::now();
+  mining.store(false);
 
+  // logger goes first, before the client warm-up: client threads log right
+  // away, and spdlog's default logger can't be replaced under them
   configureLogger(cfg);
   spdlog::info("Starting with {}", cfg);
 
-  this->exec = std::make_unique<Executor>(cfg);
+  // one or two threads are enough for the whole rig: miners are separate
+  // processes, reactor only handles their pipes and timers
+  constexpr std::size_t reactorThreads = 2;
+  reactor = std::make_unique<Reactor>(reactorThreads);
+
+  // transient server failures are retried instead of stopping the client,
+  // retries fail over to other endpoints if there are any and stop while
+  // all of them are down
+  auto endpoints = std::make_unique<FailoverClient>(
+      cfg.url, [&cfg](const std::string &url) {
+        auto it = cfg.compression.find(url);
+        if (it == cfg.compression.end()) {
+          it = cfg.compression.find("");
+        }
+        auto compression = it != cfg.compression.end()
+                               ? it->second
+                               : model::Compression::responses;
+        return std::make_unique<HTTPClient>(url, cfg.token, cfg.poolSize,
+                                            compression, cfg.sessionDir);
+      });
+  std::unique_ptr<Client> fetching = std::move(endpoints);
+  // slow task fetches are raced by a second request to another connection or
+  // endpoint, so a stalled one doesn't hold the round back
+  if (cfg.hedgePercentile > 0) {
+    auto hedging = std::make_unique<HedgedClient>(
+        std::move(fetching), reactor->Get(),
+        static_cast<double>(cfg.hedgePercentile));
+    hedged = hedging.get();
+    fetching = std::move(hedging);
+  }
+  auto guarded = std::make_unique<BreakerClient>(std::move(fetching));
+  breaker = guarded.get();
+  client = std::make_unique<RetryClient>(std::move(guarded), reactor->Get());
+  client->SetBudget(std::chrono::seconds(cfg.taskTimeout));
+  // DNS, TCP and TLS setup of registration overlaps with the rest of startup
+  auto registered = client->AsyncRegister();
+
+  scheduler = std::make_unique<RoundScheduler>(cfg.iterations);
+
+  reactor->OnSignal([this](int signal) {
+    spdlog::warn("Got signal {}, stopping", signal);
+    Stop();
+  });
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    config.emplace(cfg);
+    // config file overrides command line
+    if (!cfg.configPath.empty()) {
+      auto loaded = ConfigWatcher::Load(cfg.configPath);
+      if (loaded) {
+        spdlog::info("Config loaded: {}", Dump(loaded.value()));
+        config->boostFactor = loaded->boostFactor.value_or(cfg.boostFactor);
+        config->miner = loaded->miner.value_or(cfg.miner);
+        config->gpu = loaded->gpu.value_or(cfg.gpu);
+      }
+    }
 
-  std::unique_ptr<Client> client =
-      std::make_unique<HTTPClient>(cfg.url, cfg.token);
+    lanes.clear();
+    failed = false;
+    if (config->independent) {
+      for (auto gpu : config->gpu) {
+        addLane({gpu});
+      }
+    } else {
+      addLane(config->gpu);
+    }
+  }
 
-  auto auth = client->Register();
-  if (!auth) {
-    spdlog::critical("Registration failed, inspect logs for details");
+  auto auth = registered.get();
+  if (auto *err = std::get_if<model::Err>(&auth)) {
+    spdlog::critical("Registration failed: {}", *err);
+    shutdown();
     return 1;
   }
-  spdlog::info("Registered with {}", auth.value());
+  spdlog::info("Registered with {}", std::get<model::UserInfo>(auth));
 
-  std::optional<crypto::model::Task> task;
-  while (running.load()) {
-    spdlog::debug("Request new task");
-    task = client->GetTask();
-    if (!task) {
-      spdlog::critical(
-          "Can`t get new task from server, inspect logs for details");
-      return 1;
-    }
-    spdlog::debug("Got task: {}", task.value());
+  // answers found before restart are sent before any mining starts
+  try {
+    journal = std::make_unique<AnswerJournal>(*reactor, cfg.journalPath);
+  } catch (std::exception &e) {
+    spdlog::error("Answer journal disabled: {}", e.what());
+  }
+  submitter =
+      std::make_unique<AnswerSubmitter>(*client, journal.get(), *scheduler);
+  if (journal) {
+    submitter->Replay(journal->Recover());
+  }
 
-    auto minerTask = model::MinerTask(cfg.iterations, task.value(), cfg.gpu);
-    spdlog::debug("Starting miner with task: {}", Dump(minerTask));
+  poller = std::make_unique<TaskPoller>(
+      *reactor, *client, std::chrono::seconds(cfg.pollInterval),
+      [this](const model::Task &fresh) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &lane : lanes) {
+          lane->prefetcher->Offer(fresh);
+          lane->exec->Interrupt();
+        }
+      });
 
-    auto res = exec->Run(minerTask);
-    exec->Stop();
-    if (res) {
-      spdlog::debug("Found answer: {}", Dump(res.value()));
-      model::Answer answer = res->answer;
-      printStatistic(answer.statistic);
-      spdlog::debug("Sending answer");
-      auto status = client->SendAnswer(answer);
-      if (!status) {
-        spdlog::critical("Cant send answer, inspect logs for details");
-        return 1;
-      }
-      spdlog::info("Result: {}", status.value());
+  if (cfg.subscribe) {
+    // pushed tasks take the same path as polled ones
+    subscriber = std::make_unique<TaskSubscriber>(
+        *client, [this](const model::Task &task) { poller->Push(task); });
+  }
+
+  if (!cfg.configPath.empty()) {
+    watcher = std::make_unique<ConfigWatcher>(
+        *reactor, cfg.configPath,
+        [this](const model::Reloadable &reloaded) { reload(reloaded); });
+    reactor->OnHangup([this]() { watcher->Check(true); });
+  } else {
+    reactor->OnHangup(
+        []() { spdlog::warn("Got SIGHUP, but there is no config to reload"); });
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (auto &lane : lanes) {
+      startLane(*lane);
     }
+    cond.wait(lock, [this]() { return !running.load(); });
   }
-  return 0;
+
+  auto code = shutdown();
+  std::lock_guard<std::mutex> lock(mutex);
+  return failed ? 1 : code;
 }
 
 void App::Stop() {
   if (!running.load()) {
     return;
   }
-  exec->Stop();
-  running.store(false);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running.store(false);
+  }
+  cond.notify_all();
+  // unsent answers stay in journal, so there is no point in waiting out
+  // the backoff
+  client->Stop();
+  if (hedged != nullptr) {
+    hedged->Stop();
+  }
+  stopLanes();
 }
 
-} // namespace crypto
\ No newline at end of file
+} // namespace crypto
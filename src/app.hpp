@@ -1,10 +1,27 @@
-
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <vector>
 
+#include "breakerClient.hpp"
+#include "hedgedClient.hpp"
+#include "client.hpp"
 #include "executor.hpp"
+#include "journal.hpp"
 #include "models.hpp"
+#include "poller.hpp"
+#include "prefetcher.hpp"
+#include "reactor.hpp"
+#include "retryClient.hpp"
+#include "scheduler.hpp"
+#include "subscriber.hpp"
+#include "submitter.hpp"
+#include "watcher.hpp"
 
 #ifndef APP_HPP
 #define APP_HPP
@@ -13,8 +30,61 @@ namespace crypto {
 
 class App {
 private:
-  std::unique_ptr<Executor> exec;
+  // Lane is a set of GPUs mined with its own fetch -> mine -> submit cycle.
+  // By default all GPUs share one lane, in independent mode every GPU gets
+  // its own one, so a share found on one GPU doesn't affect others.
+  struct Lane {
+    // NOTE: guarded by App mutex, as it could be reloaded
+    std::vector<int> gpu;
+    std::unique_ptr<Executor> exec;
+    std::unique_ptr<TaskPrefetcher> prefetcher;
+    // lane of GPU removed by reload is stopped, others keep working
+    std::atomic_bool stopped = false;
+    std::future<int> loop;
+    // mined while the server is unavailable
+    std::optional<model::Task> last;
+    // the last task is mined, as the server didn't give a new one
+    bool offline = false;
+  };
+
+  // Declaration order matters: reactor outlives everything using it, lanes
+  // are destroyed before the client they refer to.
+  std::unique_ptr<Reactor> reactor;
+  std::unique_ptr<RoundScheduler> scheduler;
+  std::unique_ptr<RetryClient> client;
+  // owned by the client, hedged is null if hedging is disabled
+  BreakerClient *breaker = nullptr;
+  HedgedClient *hedged = nullptr;
+  std::unique_ptr<AnswerJournal> journal;
+  std::unique_ptr<AnswerSubmitter> submitter;
+  std::unique_ptr<TaskPoller> poller;
+  std::unique_ptr<TaskSubscriber> subscriber;
+  std::unique_ptr<ConfigWatcher> watcher;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  // current settings, differs from the initial ones after reload
+  std::optional<model::Config> config;
+  std::vector<std::unique_ptr<Lane>> lanes;
+  bool failed = false;
   std::atomic_bool running;
+  // time from start to the first round is reported, as restarts pay it
+  std::chrono::steady_clock::time_point startedAt;
+  std::atomic_bool mining = false;
+
+  // Returns task to mine next, the last known one if the server is
+  // unavailable. Results with the error if there is none.
+  model::TaskResponse next(Lane &lane);
+  int mine(Lane &lane);
+  // NOTE: must be called with locked mutex
+  void addLane(std::vector<int> gpu);
+  // NOTE: must be called with locked mutex
+  void startLane(Lane &lane);
+  void stopLanes();
+  // Applies reloaded settings at the next round boundary
+  void reload(const model::Reloadable &reloaded);
+  // Stops everything started by Run, returns exit code
+  int shutdown();
 
 public:
   int Run(const model::Config &cfg);
@@ -23,4 +93,4 @@ public:
 
 } // namespace crypto
 
-#endif
\ No newline at end of file
+#endif
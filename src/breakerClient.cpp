@@ -0,0 +1,177 @@
+#include "breakerClient.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "retryClient.hpp"
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+BreakerClient::State BreakerClient::Current() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (state == State::open && clock::now() >= openUntil) {
+    return State::halfOpen;
+  }
+  return state;
+}
+
+std::optional<model::Err> BreakerClient::admit(bool &probe) {
+  std::lock_guard<std::mutex> lock(mutex);
+  probe = false;
+  if (state == State::closed) {
+    return std::nullopt;
+  }
+  if (state == State::open && clock::now() >= openUntil) {
+    state = State::halfOpen;
+  }
+  if (state == State::halfOpen && !probing) {
+    spdlog::info("Probing whether the server is back");
+    probing = true;
+    probe = true;
+    return std::nullopt;
+  }
+  return model::Err{std::nullopt, model::Err::circuitOpen,
+                    "server is unavailable, request is not sent"};
+}
+
+void BreakerClient::trip() {
+  auto exponent = std::min(trips, 5);
+  auto period = std::min(policy.minOpen * (1 << exponent), policy.maxOpen);
+  trips++;
+  state = State::open;
+  openUntil = clock::now() + period;
+  outcomes.clear();
+  spdlog::warn("Server is unavailable, requests are stopped for {}ms",
+               period.count());
+}
+
+void BreakerClient::record(bool probe, clock::duration took,
+                           const model::Err *err) {
+  std::lock_guard<std::mutex> lock(mutex);
+  // request not sent for lack of time tells nothing about the server
+  if (err != nullptr && err->code == model::Err::deadlineExceeded) {
+    if (probe) {
+      probing = false;
+    }
+    return;
+  }
+
+  // client errors are answered by a healthy server
+  Outcome outcome{err != nullptr && Retryable(*err), took > policy.slowCall};
+  if (probe) {
+    probing = false;
+    if (outcome.failed || outcome.slow) {
+      trip();
+      return;
+    }
+    spdlog::info("Server is back, requests are resumed");
+    state = State::closed;
+    trips = 0;
+    outcomes.clear();
+    return;
+  }
+  // request let through before the breaker was opened
+  if (state != State::closed) {
+    return;
+  }
+
+  outcomes.push_back(outcome);
+  if (outcomes.size() > policy.window) {
+    outcomes.pop_front();
+  }
+  if (outcomes.size() < policy.minRequests) {
+    return;
+  }
+  auto failed = std::count_if(outcomes.begin(), outcomes.end(),
+                              [](const Outcome &o) { return o.failed; });
+  auto slow = std::count_if(outcomes.begin(), outcomes.end(),
+                            [](const Outcome &o) { return o.slow; });
+  auto total = static_cast<double>(outcomes.size());
+  if (failed / total >= policy.threshold ||
+      slow / total >= policy.threshold) {
+    spdlog::warn("{} of last {} requests failed, {} were slow", failed,
+                 outcomes.size(), slow);
+    trip();
+  }
+}
+
+template <class T, class F>
+std::variant<model::Err, T> BreakerClient::call(F &&request) {
+  bool probe = false;
+  if (auto rejected = admit(probe)) {
+    return rejected.value();
+  }
+  auto start = clock::now();
+  auto resp = request();
+  record(probe, clock::now() - start, std::get_if<model::Err>(&resp));
+  return resp;
+}
+
+template <class T, class F>
+void BreakerClient::asyncCall(F &&request, Handler<T> handler) {
+  bool probe = false;
+  if (auto rejected = admit(probe)) {
+    handler(rejected.value());
+    return;
+  }
+  auto start = clock::now();
+  request([this, probe, start,
+           handler = std::move(handler)](std::variant<model::Err, T> resp) {
+    record(probe, clock::now() - start, std::get_if<model::Err>(&resp));
+    handler(std::move(resp));
+  });
+}
+
+model::RegisterResponse BreakerClient::doRegister(Deadline deadline) {
+  return call<model::UserInfo>(
+      [this, deadline]() { return client->TryRegister(deadline); });
+}
+
+model::TaskResponse BreakerClient::doGetTask(Deadline deadline) {
+  return call<model::Task>(
+      [this, deadline]() { return client->TryGetTask(deadline); });
+}
+
+model::SendAnswerResponse
+BreakerClient::doSendAnswer(const model::Answer &answer, Deadline deadline) {
+  return call<model::AnswerStatus>([this, &answer, deadline]() {
+    return client->TrySendAnswer(answer, deadline);
+  });
+}
+
+void BreakerClient::doAsyncRegister(Deadline deadline,
+                                    Handler<model::UserInfo> handler) {
+  asyncCall<model::UserInfo>(
+      [this, deadline](Handler<model::UserInfo> h) {
+        client->AsyncRegister(std::move(h), deadline);
+      },
+      std::move(handler));
+}
+
+void BreakerClient::doAsyncGetTask(Deadline deadline,
+                                   Handler<model::Task> handler) {
+  asyncCall<model::Task>(
+      [this, deadline](Handler<model::Task> h) {
+        client->AsyncGetTask(std::move(h), deadline);
+      },
+      std::move(handler));
+}
+
+void BreakerClient::doAsyncSendAnswer(const model::Answer &answer,
+                                      Deadline deadline,
+                                      Handler<model::AnswerStatus> handler) {
+  asyncCall<model::AnswerStatus>(
+      [this, &answer, deadline](Handler<model::AnswerStatus> h) {
+        client->AsyncSendAnswer(answer, std::move(h), deadline);
+      },
+      std::move(handler));
+}
+
+model::Err BreakerClient::doSubscribe(const TaskCallback &onTask) {
+  return client->Subscribe(onTask);
+}
+
+void BreakerClient::doUnsubscribe() { client->Unsubscribe(); }
+
+} // namespace crypto
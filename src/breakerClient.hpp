@@ -0,0 +1,103 @@
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <variant>
+
+#include "client.hpp"
+#include "models.hpp"
+
+#ifndef BREAKER_CLIENT_HPP
+#define BREAKER_CLIENT_HPP
+
+namespace crypto {
+
+struct BreakerPolicy {
+  using duration = std::chrono::milliseconds;
+
+  // outcomes of so many recent requests are considered
+  std::size_t window = 20;
+  // breaker is not opened on fewer outcomes
+  std::size_t minRequests = 5;
+  // share of failed or slow requests opening the breaker
+  double threshold = 0.5;
+  // request taking longer is slow, even if it succeeded
+  duration slowCall = std::chrono::seconds(5);
+  // open period doubles with every failed probe, from minOpen up to maxOpen
+  duration minOpen = std::chrono::seconds(5);
+  duration maxOpen = std::chrono::seconds(120);
+};
+
+// BreakerClient keeps requests off a server which is down, so retries don't
+// turn into a stream of new connections. Closed breaker passes requests and
+// tracks outcomes of the recent ones, it opens when too many of them failed
+// or were slow. Open breaker fails requests at once. After a while it gets
+// half-open and lets a single probe through: probe success closes it, failure
+// opens it again for twice as long.
+class BreakerClient final : public Client {
+public:
+  using clock = std::chrono::steady_clock;
+
+  enum class State { closed, open, halfOpen };
+
+private:
+  struct Outcome {
+    bool failed;
+    bool slow;
+  };
+
+  std::unique_ptr<Client> client;
+  const BreakerPolicy policy;
+
+  mutable std::mutex mutex;
+  State state = State::closed;
+  std::deque<Outcome> outcomes;
+  // openings in a row without a successful probe
+  int trips = 0;
+  clock::time_point openUntil;
+  bool probing = false;
+
+public:
+  explicit BreakerClient(std::unique_ptr<Client> _client,
+                         BreakerPolicy _policy = BreakerPolicy{})
+      : client(std::move(_client)), policy(_policy) {}
+  ~BreakerClient() final = default;
+
+  // Open breaker is reported half-open once it is time to probe the server
+  State Current() const;
+
+private:
+  // Returns error if request is not let through. Probe is the request
+  // deciding whether half-open breaker is closed.
+  std::optional<model::Err> admit(bool &probe);
+  // NOTE: err is null if request succeeded
+  void record(bool probe, clock::duration took, const model::Err *err);
+  // NOTE: must be called with locked mutex
+  void trip();
+
+  template <class T, class F>
+  std::variant<model::Err, T> call(F &&request);
+  template <class T, class F> void asyncCall(F &&request, Handler<T> handler);
+
+  model::RegisterResponse doRegister(Deadline deadline) final;
+  model::TaskResponse doGetTask(Deadline deadline) final;
+  model::SendAnswerResponse doSendAnswer(const model::Answer &answer,
+                                         Deadline deadline) final;
+
+  void doAsyncRegister(Deadline deadline,
+                       Handler<model::UserInfo> handler) final;
+  void doAsyncGetTask(Deadline deadline, Handler<model::Task> handler) final;
+  void doAsyncSendAnswer(const model::Answer &answer, Deadline deadline,
+                         Handler<model::AnswerStatus> handler) final;
+
+  // task channel is not broken, subscriber backs off on its own
+  model::Err doSubscribe(const TaskCallback &onTask) final;
+  void doUnsubscribe() final;
+};
+
+} // namespace crypto
+
+#endif
@@ -1,7 +1,13 @@
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
 #include <optional>
 #include <string_view>
+#include <variant>
 
 #include "models.hpp"
+#include "spdlog/spdlog.h"
 
 #ifndef CLIENT_HPP
 #define CLIENT_HPP
@@ -9,11 +15,59 @@
 namespace crypto {
 
 class Client {
+public:
+  // Handler is called exactly once, when request is done. It may be called
+  // on a client thread, so it must not block.
+  template <class T>
+  using Handler = std::function<void(std::variant<model::Err, T>)>;
+  using TaskCallback = std::function<void(const model::Task &)>;
+  // Request must be finished by its deadline, retries included
+  using Deadline = std::chrono::system_clock::time_point;
+
 private:
-  virtual std::optional<model::UserInfo> doRegister() = 0;
-  virtual std::optional<model::Task> doGetTask() = 0;
-  virtual std::optional<model::AnswerStatus>
-  doSendAnswer(const model::Answer &) = 0;
+  std::chrono::milliseconds budget = std::chrono::seconds(10);
+
+  virtual model::RegisterResponse doRegister(Deadline deadline) = 0;
+  virtual model::TaskResponse doGetTask(Deadline deadline) = 0;
+  virtual model::SendAnswerResponse doSendAnswer(const model::Answer &,
+                                                 Deadline deadline) = 0;
+
+  virtual void doAsyncRegister(Deadline deadline,
+                               Handler<model::UserInfo> handler) = 0;
+  virtual void doAsyncGetTask(Deadline deadline,
+                              Handler<model::Task> handler) = 0;
+  // NOTE: answer must be copied if it is used after return
+  virtual void doAsyncSendAnswer(const model::Answer &answer,
+                                 Deadline deadline,
+                                 Handler<model::AnswerStatus> handler) = 0;
+
+  virtual model::Err doSubscribe(const TaskCallback &onTask) = 0;
+  virtual void doUnsubscribe() = 0;
+
+  template <class T>
+  static std::optional<T> valueOrLog(std::variant<model::Err, T> resp,
+                                     std::string_view what) {
+    std::optional<T> res = std::nullopt;
+    std::visit(model::util::overload{
+                   [what](const model::Err &err) {
+                     spdlog::critical("Can`t {}: {}", what, err);
+                   },
+                   [&res](T &value) { res = std::move(value); }},
+               resp);
+    return res;
+  }
+
+  template <class T>
+  static std::pair<Handler<T>, std::future<std::variant<model::Err, T>>>
+  promised() {
+    auto promise =
+        std::make_shared<std::promise<std::variant<model::Err, T>>>();
+    auto future = promise->get_future();
+    return {[promise](std::variant<model::Err, T> resp) {
+              promise->set_value(std::move(resp));
+            },
+            std::move(future)};
+  }
 
 public:
   Client() = default;
@@ -26,13 +80,94 @@ public:
   virtual ~Client() = default;
 
 public:
-  std::optional<model::UserInfo> Register() { return doRegister(); }
-  std::optional<model::Task> GetTask() { return doGetTask(); }
-  std::optional<model::AnswerStatus> SendAnswer(const model::Answer &answer) {
-    return doSendAnswer(answer);
+  // Sets time given to register and task requests without explicit deadline.
+  // Answers are given time until their task expires.
+  void SetBudget(std::chrono::milliseconds _budget) { budget = _budget; }
+
+  Deadline FromBudget() const {
+    return std::chrono::system_clock::now() + budget;
+  }
+  static Deadline FromExpiry(const model::Answer &answer) {
+    return answer.expires.GetChrono();
+  }
+
+  // Results with the error, if request failed
+  model::RegisterResponse
+  TryRegister(std::optional<Deadline> deadline = std::nullopt) {
+    return doRegister(deadline.value_or(FromBudget()));
+  }
+  model::TaskResponse
+  TryGetTask(std::optional<Deadline> deadline = std::nullopt) {
+    return doGetTask(deadline.value_or(FromBudget()));
+  }
+  model::SendAnswerResponse
+  TrySendAnswer(const model::Answer &answer,
+                std::optional<Deadline> deadline = std::nullopt) {
+    return doSendAnswer(answer, deadline.value_or(FromExpiry(answer)));
+  }
+
+  // Results with the error logged
+  std::optional<model::UserInfo>
+  Register(std::optional<Deadline> deadline = std::nullopt) {
+    return valueOrLog(TryRegister(deadline), "register");
+  }
+  std::optional<model::Task>
+  GetTask(std::optional<Deadline> deadline = std::nullopt) {
+    return valueOrLog(TryGetTask(deadline), "get task");
+  }
+  std::optional<model::AnswerStatus>
+  SendAnswer(const model::Answer &answer,
+             std::optional<Deadline> deadline = std::nullopt) {
+    return valueOrLog(TrySendAnswer(answer, deadline), "send answer");
+  }
+
+  // Asynchronous requests, the calling thread is not blocked
+  void AsyncRegister(Handler<model::UserInfo> handler,
+                     std::optional<Deadline> deadline = std::nullopt) {
+    doAsyncRegister(deadline.value_or(FromBudget()), std::move(handler));
+  }
+  void AsyncGetTask(Handler<model::Task> handler,
+                    std::optional<Deadline> deadline = std::nullopt) {
+    doAsyncGetTask(deadline.value_or(FromBudget()), std::move(handler));
+  }
+  void AsyncSendAnswer(const model::Answer &answer,
+                       Handler<model::AnswerStatus> handler,
+                       std::optional<Deadline> deadline = std::nullopt) {
+    doAsyncSendAnswer(answer, deadline.value_or(FromExpiry(answer)),
+                      std::move(handler));
+  }
+
+  // Asynchronous requests with results delivered by futures
+  std::future<model::RegisterResponse>
+  AsyncRegister(std::optional<Deadline> deadline = std::nullopt) {
+    auto [handler, future] = promised<model::UserInfo>();
+    AsyncRegister(std::move(handler), deadline);
+    return std::move(future);
+  }
+  std::future<model::TaskResponse>
+  AsyncGetTask(std::optional<Deadline> deadline = std::nullopt) {
+    auto [handler, future] = promised<model::Task>();
+    AsyncGetTask(std::move(handler), deadline);
+    return std::move(future);
+  }
+  std::future<model::SendAnswerResponse>
+  AsyncSendAnswer(const model::Answer &answer,
+                  std::optional<Deadline> deadline = std::nullopt) {
+    auto [handler, future] = promised<model::AnswerStatus>();
+    AsyncSendAnswer(answer, std::move(handler), deadline);
+    return std::move(future);
+  }
+
+  // Keeps a channel open for tasks pushed by the server and calls onTask for
+  // every one of them. Blocks while the channel is open, returns the reason
+  // it was closed.
+  model::Err Subscribe(const TaskCallback &onTask) {
+    return doSubscribe(onTask);
   }
+  // Closes the channel, further Subscribe calls return at once
+  void Unsubscribe() { doUnsubscribe(); }
 };
 
 } // namespace crypto
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,401 @@
+#include "decoder.hpp"
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "fmt/core.h"
+#include "nlohmann/json.hpp"
+
+namespace crypto::model {
+
+namespace {
+
+using json = nlohmann::json;
+
+// Value is a scalar value of the top level field
+using Value = std::variant<std::nullptr_t, bool, json::number_integer_t,
+                           json::number_unsigned_t, json::number_float_t,
+                           std::string>;
+
+const char *typeName(const Value &v) {
+  static constexpr std::array<const char *, std::variant_size_v<Value>>
+      names = {"null", "boolean", "integer", "integer", "float", "string"};
+  return names[v.index()];
+}
+
+bool toString(std::string &to, Value &v) {
+  auto *s = std::get_if<std::string>(&v);
+  if (s == nullptr) {
+    return false;
+  }
+  to = std::move(*s);
+  return true;
+}
+
+bool toLong(long &to, const Value &v) {
+  if (const auto *i = std::get_if<json::number_integer_t>(&v)) {
+    to = static_cast<long>(*i);
+    return true;
+  }
+  const auto *u = std::get_if<json::number_unsigned_t>(&v);
+  if (u == nullptr || *u > std::numeric_limits<long>::max()) {
+    return false;
+  }
+  to = static_cast<long>(*u);
+  return true;
+}
+
+template <class T> struct Field {
+  std::string_view name;
+  const char *expected;
+  // returns false if value has other type
+  bool (*assign)(T &, Value &);
+};
+
+template <class T> struct Schema;
+
+template <> struct Schema<UserInfo> {
+  static inline const std::array<Field<UserInfo>, 3> fields = {{
+      {"pool_address", "string",
+       [](UserInfo &u, Value &v) { return toString(u.pool_address, v); }},
+      {"user_address", "string",
+       [](UserInfo &u, Value &v) { return toString(u.user_address, v); }},
+      {"shares", "integer",
+       [](UserInfo &u, Value &v) { return toLong(u.shares, v); }},
+  }};
+};
+
+template <> struct Schema<Task> {
+  static inline const std::array<Field<Task>, 5> fields = {{
+      {"seed", "string",
+       [](Task &t, Value &v) { return toString(t.seed, v); }},
+      {"complexity", "string",
+       [](Task &t, Value &v) { return toString(t.complexity, v); }},
+      {"giver_address", "string",
+       [](Task &t, Value &v) { return toString(t.giver_address, v); }},
+      {"pool_address", "string",
+       [](Task &t, Value &v) { return toString(t.pool_address, v); }},
+      {"expires", "integer",
+       [](Task &t, Value &v) {
+         long tmp = 0;
+         if (!toLong(tmp, v)) {
+           return false;
+         }
+         t.expires = util::Timestamp(tmp);
+         return true;
+       }},
+  }};
+};
+
+template <> struct Schema<AnswerStatus> {
+  static inline const std::array<Field<AnswerStatus>, 1> fields = {{
+      {"status", "string",
+       [](AnswerStatus &s, Value &v) {
+         std::string status;
+         if (!toString(status, v)) {
+           return false;
+         }
+         s.accepted = status == "ACCEPTED";
+         return true;
+       }},
+  }};
+};
+
+// Handler implements nlohmann SAX interface. Values nested into unknown keys
+// are skipped without being stored anywhere.
+template <class T> class Handler {
+private:
+  static constexpr auto &fields = Schema<T>::fields;
+  static constexpr std::size_t none = std::tuple_size_v<
+      std::remove_reference_t<decltype(Schema<T>::fields)>>;
+
+  T &result;
+  std::string error;
+  std::size_t depth = 0;
+  // field the next value belongs to, none for unknown keys
+  std::size_t field = none;
+  std::bitset<none> seen;
+
+  bool fail(std::string msg) {
+    error = std::move(msg);
+    return false;
+  }
+
+  bool value(Value v) {
+    if (depth == 0) {
+      return fail(fmt::format("expected object, got {}", typeName(v)));
+    }
+    if (depth > 1 || field == none) {
+      return true;
+    }
+    const auto &f = fields[field];
+    if (!f.assign(result, v)) {
+      if (std::holds_alternative<json::number_unsigned_t>(v) &&
+          std::string_view(f.expected) == "integer") {
+        return fail(fmt::format("field {}: integer out of range", f.name));
+      }
+      return fail(fmt::format("field {}: expected {}, got {}", f.name,
+                              f.expected, typeName(v)));
+    }
+    seen.set(field);
+    return true;
+  }
+
+  bool nested(const char *kind) {
+    if (depth == 0 && std::string_view(kind) != "object") {
+      return fail(fmt::format("expected object, got {}", kind));
+    }
+    if (depth == 1 && field != none) {
+      const auto &f = fields[field];
+      return fail(fmt::format("field {}: expected {}, got {}", f.name,
+                              f.expected, kind));
+    }
+    depth++;
+    return true;
+  }
+
+public:
+  explicit Handler(T &_result) : result(_result) {}
+
+  // Returns description of the first problem, empty if there was none
+  std::string Error() const {
+    if (!error.empty()) {
+      return error;
+    }
+    for (std::size_t i = 0; i < none; i++) {
+      if (!seen.test(i)) {
+        return fmt::format("field {} is missing", fields[i].name);
+      }
+    }
+    return "";
+  }
+
+  bool null() { return value(nullptr); }
+  bool boolean(bool val) { return value(val); }
+  bool number_integer(json::number_integer_t val) { return value(val); }
+  bool number_unsigned(json::number_unsigned_t val) { return value(val); }
+  bool number_float(json::number_float_t val, const json::string_t &) {
+    return value(val);
+  }
+  bool string(json::string_t &val) { return value(std::move(val)); }
+  bool binary(json::binary_t &) { return fail("unexpected binary value"); }
+
+  bool start_object(std::size_t) { return nested("object"); }
+  bool start_array(std::size_t) { return nested("array"); }
+  bool end_object() {
+    depth--;
+    return true;
+  }
+  bool end_array() {
+    depth--;
+    return true;
+  }
+
+  bool key(json::string_t &k) {
+    if (depth != 1) {
+      return true;
+    }
+    field = none;
+    for (std::size_t i = 0; i < none; i++) {
+      if (fields[i].name == k) {
+        field = i;
+        break;
+      }
+    }
+    return true;
+  }
+
+  bool parse_error(std::size_t position, const std::string &,
+                   const json::exception &e) {
+    return fail(fmt::format("malformed json at byte {}: {}", position,
+                            e.what()));
+  }
+};
+
+// ListHandler decodes array of flat objects, every element is decoded by
+// Handler of its own
+template <class T> class ListHandler {
+private:
+  std::vector<T> &result;
+  std::string error;
+  std::size_t depth = 0;
+  T current{};
+  std::optional<Handler<T>> item;
+
+  bool fail(std::string msg) {
+    error = std::move(msg);
+    return false;
+  }
+
+  // Forwards event to the handler of the current element
+  template <class F> bool forward(F &&event) {
+    return item && event(item.value());
+  }
+
+  bool scalar() {
+    if (depth == 0) {
+      return fail("expected array");
+    }
+    return fail(fmt::format("item {}: expected object", result.size()));
+  }
+
+  bool nested(bool object) {
+    if (depth == 0) {
+      if (object) {
+        return fail("expected array, got object");
+      }
+      depth++;
+      return true;
+    }
+    if (depth == 1) {
+      if (!object) {
+        return fail(
+            fmt::format("item {}: expected object, got array", result.size()));
+      }
+      current = T{};
+      item.emplace(current);
+    }
+    depth++;
+    return forward([object](Handler<T> &h) {
+      return object ? h.start_object(0) : h.start_array(0);
+    });
+  }
+
+  bool end(bool object) {
+    depth--;
+    if (depth == 0) {
+      return true;
+    }
+    if (!forward([object](Handler<T> &h) {
+          return object ? h.end_object() : h.end_array();
+        })) {
+      return false;
+    }
+    if (depth > 1) {
+      return true;
+    }
+    auto problem = item->Error();
+    if (!problem.empty()) {
+      return fail(fmt::format("item {}: {}", result.size(), problem));
+    }
+    result.push_back(std::move(current));
+    item.reset();
+    return true;
+  }
+
+  template <class V> bool value(V &&val) {
+    if (depth < 2) {
+      return scalar();
+    }
+    return forward([&val](Handler<T> &h) {
+      using U = std::decay_t<V>;
+      if constexpr (std::is_same_v<U, std::nullptr_t>) {
+        return h.null();
+      } else if constexpr (std::is_same_v<U, bool>) {
+        return h.boolean(val);
+      } else if constexpr (std::is_same_v<U, json::number_integer_t>) {
+        return h.number_integer(val);
+      } else if constexpr (std::is_same_v<U, json::number_unsigned_t>) {
+        return h.number_unsigned(val);
+      } else if constexpr (std::is_same_v<U, json::number_float_t>) {
+        return h.number_float(val, "");
+      } else {
+        return h.string(val);
+      }
+    });
+  }
+
+public:
+  explicit ListHandler(std::vector<T> &_result) : result(_result) {}
+
+  std::string Error() const {
+    if (!error.empty()) {
+      return error;
+    }
+    if (item) {
+      return fmt::format("item {}: {}", result.size(), item->Error());
+    }
+    return "";
+  }
+
+  bool null() { return value(nullptr); }
+  bool boolean(bool val) { return value(val); }
+  bool number_integer(json::number_integer_t val) { return value(val); }
+  bool number_unsigned(json::number_unsigned_t val) { return value(val); }
+  bool number_float(json::number_float_t val, const json::string_t &) {
+    return value(val);
+  }
+  bool string(json::string_t &val) { return value(val); }
+  bool binary(json::binary_t &) { return fail("unexpected binary value"); }
+
+  bool start_object(std::size_t) { return nested(true); }
+  bool start_array(std::size_t) { return nested(false); }
+  bool end_object() { return end(true); }
+  bool end_array() { return end(false); }
+
+  bool key(json::string_t &k) {
+    if (depth < 2) {
+      return true;
+    }
+    return forward([&k](Handler<T> &h) { return h.key(k); });
+  }
+
+  bool parse_error(std::size_t position, const std::string &,
+                   const json::exception &e) {
+    return fail(fmt::format("malformed json at byte {}: {}", position,
+                            e.what()));
+  }
+};
+
+template <class T> std::variant<Err, T> decode(std::string_view body) {
+  T result{};
+  Handler<T> handler(result);
+  json::sax_parse(body, &handler);
+  auto error = handler.Error();
+  if (!error.empty()) {
+    return Err{std::string(body), -1, std::move(error)};
+  }
+  return result;
+}
+
+template <class T>
+std::variant<Err, std::vector<T>> decodeList(std::string_view body) {
+  std::vector<T> result;
+  ListHandler<T> handler(result);
+  json::sax_parse(body, &handler);
+  auto error = handler.Error();
+  if (!error.empty()) {
+    return Err{std::string(body), -1, std::move(error)};
+  }
+  return result;
+}
+
+} // namespace
+
+template <> std::variant<Err, UserInfo> Decode(std::string_view body) {
+  return decode<UserInfo>(body);
+}
+
+template <> std::variant<Err, Task> Decode(std::string_view body) {
+  return decode<Task>(body);
+}
+
+template <> std::variant<Err, AnswerStatus> Decode(std::string_view body) {
+  return decode<AnswerStatus>(body);
+}
+
+template <>
+std::variant<Err, std::vector<AnswerStatus>> Decode(std::string_view body) {
+  return decodeList<AnswerStatus>(body);
+}
+
+} // namespace crypto::model
@@ -0,0 +1,28 @@
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "models.hpp"
+
+#ifndef DECODER_HPP
+#define DECODER_HPP
+
+namespace crypto::model {
+
+// Decode fills model struct right from the response body with SAX parser, no
+// intermediate json document is built and string values are moved out of the
+// parser buffer. Body must be a flat json object: unknown keys are skipped,
+// missing, mistyped and nested fields are reported by name, malformed json by
+// its byte offset.
+template <class T> std::variant<Err, T> Decode(std::string_view body);
+
+template <> std::variant<Err, UserInfo> Decode(std::string_view body);
+template <> std::variant<Err, Task> Decode(std::string_view body);
+template <> std::variant<Err, AnswerStatus> Decode(std::string_view body);
+// statuses of batched answers are an array of such objects
+template <>
+std::variant<Err, std::vector<AnswerStatus>> Decode(std::string_view body);
+
+} // namespace crypto::model
+
+#endif
@@ -2,39 +2,35 @@
 
 #include "models.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <exception>
 #include <fstream>
-#include <future>
 #include <ios>
 #include <istream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
-#include <thread>
 #include <variant>
 #include <vector>
 
 #include "boost/asio.hpp"
+#include "boost/asio/steady_timer.hpp"
 #include "boost/asio/streambuf.hpp"
 #include "boost/exception/exception.hpp"
-#include "boost/fiber/algo/algorithm.hpp"
-#include "boost/fiber/algo/shared_work.hpp"
-#include "boost/fiber/buffered_channel.hpp"
-#include "boost/fiber/channel_op_status.hpp"
 #include "boost/fiber/condition_variable.hpp"
-#include "boost/fiber/fiber.hpp"
 #include "boost/fiber/mutex.hpp"
-#include "boost/fiber/operations.hpp"
 #include "boost/filesystem.hpp"
 #include "boost/multiprecision/cpp_int.hpp"
 #include "boost/process.hpp"
 #include "boost/process/args.hpp"
-#include "boost/process/detail/child_decl.hpp"
+#include "boost/process/async.hpp"
+#include "boost/process/async_pipe.hpp"
 #include "boost/process/exception.hpp"
 #include "boost/process/group.hpp"
 #include "boost/process/io.hpp"
@@ -68,7 +64,12 @@ std::string Executor::taskToArgs(const model::MinerTask &t, int gpu) {
   return fmt::format("-vv -g {} -F {} -e {} {} {} {} {} {} {}", gpu, factor,
                      t.expires.GetUnix(), t.pool_address,
                      bm::to_string(seedBigInt), bm::to_string(complexityBigInt),
-                     t.iterations, t.giver_address, resName);
+                     t.iterations, t.giver_address, resultPath(gpu).string());
+}
+
+boost::filesystem::path Executor::resultPath(int gpu) const {
+  // every miner writes to its own file, as they may find answers concurrently
+  return result_dir / fmt::format("mined_{}.boc", gpu);
 }
 
 std::vector<std::string> parsed(std::string args) {
@@ -80,175 +81,388 @@ std::vector<std::string> parsed(std::string args) {
   return res;
 }
 
-exec_res::ExecRes Executor::execSafe(const model::MinerTask &task, int gpu) {
-  using namespace exec_res;
-  ExecRes res;
+std::optional<model::Statistic> parseStatistic(std::string_view out) {
+  // verbose miner prints its hash rate like `[ speed: 1.23e+09 hps ]`
+  static const boost::regex speed("speed:\\s*([0-9.eE+-]+)\\s*hps");
+  boost::match_results<std::string_view::const_iterator> match;
+  if (!boost::regex_search(out.begin(), out.end(), match, speed)) {
+    return std::nullopt;
+  }
   try {
-    res = exec(task, gpu);
-  } catch (boost::process::process_error &e) {
-    res = Crash("Exec got boost exception: {}; code: {}", e.what(),
-                e.code().message());
-  } catch (std::exception &e) {
-    res = Crash("Exec got exception: {}", e.what());
-  } catch (...) {
-    res = Crash("Exec got unknown exception");
+    return model::Statistic{0, static_cast<long long>(std::stod(match[1]))};
+  } catch (std::exception &) {
+    return std::nullopt;
   }
-  return res;
 }
 
-std::optional<model::Statistic> parseStatistic(std::string_view out) {
-  return std::nullopt;
-}
-
-exec_res::ExecRes Executor::exec(const model::MinerTask &task, int gpu) {
-  boost::asio::io_service ios;
-  std::future<std::string> outData;
+struct Executor::Miner {
+  Miner(boost::asio::io_context &ioc, model::MinerTask _task, int _gpu,
+        long _gen)
+      : task(std::move(_task)), gpu(_gpu), gen(_gen), out(ioc), err(ioc),
+        deadline(ioc) {}
+
+  model::MinerTask task;
+  int gpu;
+  long gen;
+
+  bp::group group;
+  bp::child child;
+  bp::async_pipe out;
+  bp::async_pipe err;
+  boost::asio::streambuf outData;
   boost::asio::streambuf errData;
+  boost::asio::steady_timer deadline;
+
+  // miner is completed after process exit and both pipes EOF
+  int pending = 3;
+  int code = 0;
+  bool timedOut = false;
+  // GPU was removed from the task, outcome is ignored
+  bool dropped = false;
+  std::optional<std::string> failure;
+};
+
+void Executor::spawn(const model::MinerTask &task, int gpu) {
+  auto &ioc = reactor.Get();
+  auto miner = std::make_shared<Miner>(ioc, task, gpu, generation);
+  miners[gpu] = miner;
+
+  spdlog::info("Starting miner for GPU #{}", gpu);
+
+  // answer left from the previous run must not be taken for a new one
+  boost::system::error_code ignored;
+  boost::filesystem::remove(resultPath(gpu), ignored);
 
   auto args = taskToArgs(task, gpu);
   spdlog::info("Miner args: {}", args);
 
-  auto _pgCopy = this->pg;
-  bp::child ch(path.string(), *_pgCopy, bp::args(parsed(args)),
-               bp::std_in.close(), bp::std_err > errData, bp::std_out > outData,
-               ios);
+  // every handler of the miner lands here, last one completes it
+  auto step = [this, miner]() {
+    bool done = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = --miner->pending == 0;
+    }
+    if (done) {
+      complete(miner);
+    }
+    settled();
+  };
+
+  try {
+    miner->child = bp::child(
+        path.string(), miner->group, bp::args(parsed(args)), bp::std_in.close(),
+        bp::std_out > miner->out, bp::std_err > miner->err, ioc,
+        bp::on_exit([miner, step](int code, const std::error_code &ec) {
+          miner->code = code;
+          if (ec) {
+            miner->failure = fmt::format("exit wait failed: {}", ec.message());
+          }
+          step();
+        }));
+  } catch (boost::process::process_error &e) {
+    miner->failure = fmt::format("Exec got boost exception: {}; code: {}",
+                                 e.what(), e.code().message());
+    miner->pending = 1;
+    handlers++;
+    boost::asio::post(ioc, step);
+    return;
+  }
+  // exit, two pipes and the deadline, they can't run before the mutex is
+  // released by the caller
+  handlers += 4;
+
+  boost::asio::async_read(
+      miner->out, miner->outData,
+      [step](const boost::system::error_code &, std::size_t) { step(); });
+  boost::asio::async_read(
+      miner->err, miner->errData,
+      [step](const boost::system::error_code &, std::size_t) { step(); });
+
+  // task deadline is a wall clock time, steady timer is used to not depend on
+  // the clock adjustments during the round
+  miner->deadline.expires_after(task.deadline -
+                                std::chrono::system_clock::now());
+  miner->deadline.async_wait(
+      [this, miner](const boost::system::error_code &ec) {
+        if (ec != boost::asio::error::operation_aborted) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (miner->pending != 0) {
+            miner->timedOut = true;
+            std::error_code terminateErr;
+            miner->group.terminate(terminateErr);
+          }
+        }
+        settled();
+      });
+}
 
-  ios.run();
-  auto status = outData.wait_until(task.expires.GetChrono());
-  if (status == std::future_status::timeout) {
-    ch.terminate();
-    ch.wait();
+void Executor::settled() {
+  // destructor may proceed once the lock is released, nothing of this is
+  // touched after it
+  std::lock_guard<std::mutex> lock(mutex);
+  handlers--;
+  idle.notify_all();
+}
+
+exec_res::ExecRes Executor::outcome(const Miner &miner) {
+  if (miner.failure) {
+    return exec_res::Crash("{}", miner.failure.value());
+  }
+  if (miner.timedOut) {
     return exec_res::Timeout{};
   }
 
-  auto out = outData.get();
-  std::string err((std::istreambuf_iterator<char>(&errData)),
-                  std::istreambuf_iterator<char>(nullptr));
+  auto bufToString = [](const boost::asio::streambuf &buf) {
+    auto data = buf.data();
+    return std::string(boost::asio::buffers_begin(data),
+                       boost::asio::buffers_end(data));
+  };
+  auto out = bufToString(miner.outData);
+  auto err = bufToString(miner.errData);
   spdlog::info("Miner stdout:\n{}", out);
   spdlog::info("Miner stderr:\n{}", err);
 
-  ch.wait();
-  auto code = ch.exit_code();
-  if (code != 0) {
-    return exec_res::Crash{"non-nil exit code", code};
+  auto statistic = parseStatistic(out + err);
+  if (statistic) {
+    scheduler.RecordRate(miner.gpu, static_cast<double>(statistic->rate));
+  }
+
+  if (miner.code != 0) {
+    return exec_res::Crash{"non-nil exit code", miner.code};
   }
 
-  if (!answerExists()) {
+  if (!answerExists(miner.gpu)) {
     return exec_res::Crash{"can`t locate boc file", -1};
   }
 
   model::Answer answer;
-  answer.giver_address = task.giver_address;
-  answer.boc = getAnswer();
-  answer.statistic = parseStatistic(out);
+  answer.giver_address = miner.task.giver_address;
+  answer.seed = miner.task.seed;
+  answer.expires = miner.task.expires;
+  answer.boc = getAnswer(miner.gpu);
+  answer.statistic = statistic;
   spdlog::debug(answer);
   return exec_res::Ok{answer};
 }
 
-std::optional<exec_res::Ok> Executor::Run(const model::MinerTask &task) {
-  if (running.load()) {
-    throw std::runtime_error("method Run called for already running Executor");
-  }
-  running.store(true);
-
-  // Here we pass Task by ref. We know, that it should work, as we
-  // terminate processes before living the scope. But anyway, it may be
-  // dangerous, so
-  //
-  // TODO: use shared_poiner for Task or some other safe sollution
-
-  this->waiter = std::make_shared<Waiter>();
-  this->pg = std::make_shared<boost::process::group>();
-
-  using buff_t = boost::fibers::buffered_channel<exec_res::Ok>;
-  auto buff = std::make_shared<buff_t>(2);
-
-  std::atomic_bool found = false;
-  for (auto gpu : task.gpu) {
-    spdlog::info("Starting miner for GPU #{}", gpu);
-    std::thread([&found, buff, task, gpu, this]() {
-      spdlog::debug("Starting task for #{}", gpu);
-      waiter->Add();
-      auto outcome = execSafe(task, gpu);
-      spdlog::debug("Exec #{} done", gpu);
-
-      using namespace exec_res;
-      std::visit(model::util::overload{
-                     [this, gpu](const Timeout &) {
-                       spdlog::info("Exec #{} timed out", gpu);
-                       waiter->Done();
-                     },
-                     [this, gpu](const Crash &c) {
-                       spdlog::warn("Exec #{} crashed: {}", gpu, Dump(c));
-                       waiter->Done();
-                     },
-                     [&found, this, buff, gpu](const Ok &ok) {
-                       if (found.load()) {
-                         return;
-                       }
-                       found.store(true);
-                       spdlog::info("Exec #{} found an answer", gpu);
-                       buff->try_push(ok);
-                       waiter->Notify();
-                     }},
-                 outcome);
-    }).detach();
+void Executor::complete(const MinerPtr &miner) {
+  auto gpu = miner->gpu;
+  spdlog::debug("Exec #{} done", gpu);
+  miner->deadline.cancel();
+
+  // killed miner has nothing to report, its hash rate would be a partial one
+  auto stale = [this, &miner]() {
+    return miner->gen != generation || miner->dropped;
+  };
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stale()) {
+      spdlog::debug("Exec #{} was dropped, ignoring its outcome", gpu);
+      return;
+    }
   }
-  waiter->Wait();
-  spdlog::debug("All miner tasks complited");
 
+  exec_res::ExecRes res;
   try {
-    if (pg->valid()) {
-      pg->terminate();
-      // waiting for no more then one second is not a rocket scince trick, but
-      // we realy prefer low possibility of zombie processes to dead locks
-      // if (!pg->wait_for(std::chrono::seconds(1))) {
-      //   spdlog::warn("Not all miners exited");
-      // }
-      pg->detach();
+    res = outcome(*miner);
+  } catch (std::exception &e) {
+    res = exec_res::Crash("Exec got exception: {}", e.what());
+  } catch (...) {
+    res = exec_res::Crash("Exec got unknown exception");
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stale()) {
+      spdlog::debug("Exec #{} outcome is stale, ignoring", gpu);
+      return;
+    }
+    miners.erase(gpu);
+
+    using namespace exec_res;
+    std::visit(model::util::overload{
+                   [gpu](const Timeout &) {
+                     spdlog::info("Exec #{} timed out", gpu);
+                   },
+                   [gpu](const Crash &c) {
+                     spdlog::warn("Exec #{} crashed: {}", gpu, Dump(c));
+                   },
+                   [this, gpu](const Ok &ok) {
+                     spdlog::info("Exec #{} found an answer", gpu);
+                     if (!seen.insert(ok.answer.boc).second) {
+                       spdlog::debug("Exec #{} answer is a duplicate", gpu);
+                       return;
+                     }
+                     if (!multiShare && !found.empty()) {
+                       spdlog::info("Answer for the round is already "
+                                    "found, dropping #{} one",
+                                    gpu);
+                       return;
+                     }
+                     found.push_back(ok);
+                     if (!multiShare) {
+                       // seed is solved, answers of other miners would be
+                       // dropped anyway
+                       stopMiners();
+                     }
+                   }},
+               res);
+  }
+  waiter->Notify();
+}
+
+bool Executor::SameWork(const model::MinerTask &lhs,
+                        const model::MinerTask &rhs) {
+  // expiration time, deadline and iterations are not compared on purpose:
+  // miner keeps the ones it was started with and exits on them, then it is
+  // restarted with the new ones
+  return lhs.seed == rhs.seed && lhs.complexity == rhs.complexity &&
+         lhs.giver_address == rhs.giver_address &&
+         lhs.pool_address == rhs.pool_address;
+}
+
+void Executor::stopMiners() {
+  generation++;
+  for (auto &[gpu, miner] : miners) {
+    // dropped miners are completed by the reactor as usual, their outcome
+    // is ignored as stale
+    miner->deadline.cancel();
+    std::error_code ec;
+    miner->group.terminate(ec);
+    if (ec) {
+      spdlog::debug("Excteption on miner #{} termination: {}", gpu,
+                    ec.message());
     }
-  } catch (const boost::process::process_error &e) {
-    spdlog::debug("Excteption on miner termination: {}, {}", e.code(),
-                  e.what());
   }
+  miners.clear();
+}
 
-  exec_res::Ok res;
-  auto status = buff->try_pop(res);
-  if (status != boost::fibers::channel_op_status::success) {
-    spdlog::debug("Buffer status: {}", status);
-    return std::nullopt;
+void Executor::dropMiners() {
+  stopMiners();
+  found.clear();
+  seen.clear();
+}
+
+void Executor::dropUnused(const model::MinerTask &task) {
+  for (auto it = miners.begin(); it != miners.end();) {
+    auto &[gpu, miner] = *it;
+    if (std::find(task.gpu.begin(), task.gpu.end(), gpu) != task.gpu.end()) {
+      ++it;
+      continue;
+    }
+    spdlog::info("GPU #{} is not used anymore, stopping its miner", gpu);
+    miner->dropped = true;
+    miner->deadline.cancel();
+    std::error_code ec;
+    miner->group.terminate(ec);
+    it = miners.erase(it);
+  }
+}
+
+std::vector<exec_res::Ok> Executor::Run(const model::MinerTask &task) {
+  if (running.exchange(true)) {
+    throw std::runtime_error("method Run called for already running Executor");
+  }
+
+  waiter->Reset();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopped) {
+      running.store(false);
+      return {};
+    }
+    if (current && !SameWork(current.value(), task)) {
+      spdlog::info("Task changed, restarting miners");
+      dropMiners();
+    }
+    if (reconfigured) {
+      spdlog::info("Miner settings changed, restarting miners");
+      reconfigured = false;
+      dropMiners();
+    }
+    dropUnused(task);
+    current = task;
+
+    // task could be changed while we were out of Run, then miners will be
+    // restarted by the next Run with the fresh task
+    if (interrupted) {
+      interrupted = false;
+      waiter->Notify();
+    } else {
+      for (auto gpu : task.gpu) {
+        if (miners.count(gpu) == 0) {
+          spawn(task, gpu);
+        } else {
+          spdlog::debug("Miner #{} is still working on the task", gpu);
+        }
+      }
+      // answers found while we were out of Run are returned right away
+      if (!found.empty()) {
+        waiter->Notify();
+      }
+    }
   }
-  buff->close();
 
+  waiter->Wait();
+  spdlog::debug("Miner event received");
+
+  std::vector<exec_res::Ok> res;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    interrupted = false;
+    res.swap(found);
+  }
+  running.store(false);
   return res;
 }
 
-void Executor::Stop() {
-  if (!running.load()) {
+void Executor::Interrupt() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    interrupted = true;
+  }
+  waiter->Notify();
+}
+
+void Executor::Reconfigure(long boostFactor,
+                           const boost::filesystem::path &miner) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (factor == boostFactor && path == miner) {
     return;
   }
-  running.store(false);
+  factor = boostFactor;
+  path = miner;
+  reconfigured = true;
+}
+
+Executor::~Executor() {
+  std::unique_lock<std::mutex> lock(mutex);
+  stopped = true;
+  dropMiners();
+  // killed miners exit at once, their handlers follow
+  idle.wait(lock, [this]() { return handlers == 0; });
+}
 
+void Executor::Stop() {
   spdlog::debug("Stopping exec");
-  waiter->Notify();
-  try {
-    if (pg->valid()) {
-      pg->terminate();
-    }
-  } catch (...) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    dropMiners();
+    current.reset();
   }
-
-  waiter.reset();
-  pg.reset();
+  waiter->Notify();
 }
 
-bool Executor::answerExists() {
+bool Executor::answerExists(int gpu) {
+  auto result_path = resultPath(gpu);
   spdlog::trace("Checking {} path answer", result_path.string());
   return boost::filesystem::exists(result_path);
 }
 
-std::vector<model::Answer::Byte> Executor::getAnswer() {
-  std::ifstream file(result_path.c_str(), std::ios::binary | std::ios::in);
+std::vector<model::Answer::Byte> Executor::getAnswer(int gpu) {
+  std::ifstream file(resultPath(gpu).c_str(), std::ios::binary | std::ios::in);
   return std::vector<model::Answer::Byte>(std::istreambuf_iterator<char>(file),
                                           std::istreambuf_iterator<char>());
 }
@@ -1,5 +1,10 @@
 #include <atomic>
+#include <condition_variable>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -10,11 +15,12 @@
 #include "boost/fiber/condition_variable.hpp"
 #include "boost/fiber/mutex.hpp"
 #include "boost/filesystem.hpp"
-#include "boost/process/group.hpp"
 #include "fmt/core.h"
 #include "fmt/format.h"
 
 #include "models.hpp"
+#include "reactor.hpp"
+#include "scheduler.hpp"
 
 #ifndef EXECUTOR_HPP
 #define EXECUTOR_HPP
@@ -26,7 +32,6 @@ private:
   boost::fibers::condition_variable cond;
   boost::fibers::mutex mutex;
   bool ready = false;
-  long n = 0;
 
 public:
   typedef std::shared_ptr<Waiter> Ptr;
@@ -36,29 +41,13 @@ public:
     return ready;
   }
 
-  void Add() {
+  void Reset() {
     std::unique_lock<boost::fibers::mutex> lock(mutex);
-    n += 1;
-  }
-
-  void Done() {
-    bool allDone = false;
-    {
-      std::unique_lock<boost::fibers::mutex> lock(mutex);
-      n -= 1;
-      if (n <= 0 && !ready) {
-        ready = true;
-        allDone = true;
-      }
-    }
-    if (allDone) {
-      cond.notify_one();
-    }
+    ready = false;
   }
 
   void Wait() {
     std::unique_lock<boost::fibers::mutex> lock(mutex);
-    ready = false;
     cond.wait(lock, [this]() { return ready; });
   }
 
@@ -111,22 +100,53 @@ inline std::string Dump(const Ok &ok) {
 
 class Executor {
 private:
-  const long factor;
-  const boost::filesystem::path path;
-  boost::filesystem::path result_path;
-  inline static const char *const resName = "mined.boc";
+  // Miner is a state of one running miner process, defined in executor.cpp
+  struct Miner;
+  using MinerPtr = std::shared_ptr<Miner>;
+
+  Reactor &reactor;
+  RoundScheduler &scheduler;
+  // miner settings could be reconfigured, new ones are applied by Run
+  long factor;
+  boost::filesystem::path path;
+  bool reconfigured = false;
+  // keep every answer found in a round instead of the first one
+  const bool multiShare;
+  boost::filesystem::path result_dir;
+
+  // Miners outlive a single Run call: if the next task differs from the
+  // current one only by expiration time, running processes are kept.
+  std::mutex mutex;
+  std::optional<model::MinerTask> current;
+  std::map<int, MinerPtr> miners;
+  std::vector<exec_res::Ok> found;
+  // answers taken for the current work, to not return the same boc twice
+  std::set<std::vector<model::Answer::Byte>> seen;
+  // generation is incremented every time miners are dropped, so outcomes of
+  // stale miners could be recognized and ignored
+  long generation = 0;
+  bool interrupted = false;
+  // stopped executor is not started again
+  bool stopped = false;
+  // reactor handlers of miners not run yet, they refer to this
+  int handlers = 0;
+  std::condition_variable idle;
 
-  std::shared_ptr<boost::process::group> pg;
   std::shared_ptr<Waiter> waiter;
   std::atomic_bool running = false;
 
 public:
-  explicit Executor(const model::Config &cfg)
-      : factor(cfg.boostFactor), path(cfg.miner) {
-    result_path = boost::filesystem::current_path() / resName;
+  Executor(const model::Config &cfg, Reactor &_reactor,
+           RoundScheduler &_scheduler)
+      : reactor(_reactor), scheduler(_scheduler), factor(cfg.boostFactor),
+        path(cfg.miner),
+        multiShare(cfg.multiShare), waiter(std::make_shared<Waiter>()) {
+    result_dir = boost::filesystem::current_path();
   };
 
-  ~Executor() = default;
+  // Stops miners and waits for their reactor handlers.
+  // NOTE: reactor must be running, so the handlers are run
+  ~Executor();
 
   Executor(Executor &) = delete;
   Executor(Executor &&) = delete;
@@ -136,14 +156,44 @@ public:
 
 private:
   std::string taskToArgs(const model::MinerTask &t, int gpu);
-  bool answerExists();
-  std::vector<model::Answer::Byte> getAnswer();
-  // TODO: Hide boost::process from user
-  exec_res::ExecRes exec(const model::MinerTask &task, int gpu);
-  exec_res::ExecRes execSafe(const model::MinerTask &task, int gpu);
+  boost::filesystem::path resultPath(int gpu) const;
+  bool answerExists(int gpu);
+  std::vector<model::Answer::Byte> getAnswer(int gpu);
+  // Starts miner process, its pipes, exit and expiration are handled by the
+  // reactor. NOTE: must be called with locked mutex
+  void spawn(const model::MinerTask &task, int gpu);
+  // Called by the reactor after miner exited and its pipes are drained
+  void complete(const MinerPtr &miner);
+  // Called at the end of every reactor handler of a miner
+  void settled();
+  exec_res::ExecRes outcome(const Miner &miner);
+  // Terminates miners, answers found by them are kept.
+  // NOTE: must be called with locked mutex
+  void stopMiners();
+  // Terminates miners and forgets answers found for their work.
+  // NOTE: must be called with locked mutex
+  void dropMiners();
+  // Stops miners of GPUs not listed in the task.
+  // NOTE: must be called with locked mutex
+  void dropUnused(const model::MinerTask &task);
 
 public:
-  std::optional<exec_res::Ok> Run(const model::MinerTask &task);
+  // Checks if tasks could be mined by the same miner processes
+  static bool SameWork(const model::MinerTask &lhs,
+                       const model::MinerTask &rhs);
+
+  // Ensures miner is running on every task GPU and waits for the first
+  // answer or for any miner to finish. Returns at most one answer, the other
+  // miners are stopped then, as the seed is solved. In multi-share mode they
+  // keep working, and all unique answers found so far are returned.
+  std::vector<exec_res::Ok> Run(const model::MinerTask &task);
+  // Makes Run return without stopping miners, next Run decides if they are
+  // still useful
+  void Interrupt();
+  // Sets miner settings, running miners are restarted with them by the next
+  // Run call if they differ from the current ones
+  void Reconfigure(long boostFactor, const boost::filesystem::path &miner);
+  // Stops miners and makes current and all further Run calls return at once
   void Stop();
 };
 
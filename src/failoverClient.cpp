@@ -0,0 +1,195 @@
+#include "failoverClient.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "retryClient.hpp"
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+FailoverClient::FailoverClient(const std::vector<std::string> &urls,
+                               const Factory &factory) {
+  if (urls.empty()) {
+    throw std::invalid_argument("No server endpoints given");
+  }
+  for (const auto &url : urls) {
+    Endpoint endpoint;
+    endpoint.url = url;
+    endpoint.client = factory(url);
+    endpoints.push_back(std::move(endpoint));
+  }
+}
+
+double FailoverClient::score(const Endpoint &endpoint) const {
+  return endpoint.rtt * (1 + errorPenalty * endpoint.errors);
+}
+
+std::size_t FailoverClient::pick() {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto now = clock::now();
+  requests++;
+
+  std::size_t best = endpoints.size();
+  std::size_t stalest = endpoints.size();
+  for (std::size_t i = 0; i < endpoints.size(); i++) {
+    const auto &endpoint = endpoints[i];
+    if (endpoint.ejectedUntil > now) {
+      continue;
+    }
+    // endpoint without a single sample is measured first
+    if (!endpoint.measured) {
+      endpoints[i].lastUsed = now;
+      return i;
+    }
+    if (best == endpoints.size() || score(endpoint) < score(endpoints[best])) {
+      best = i;
+    }
+    if (stalest == endpoints.size() ||
+        endpoint.lastUsed < endpoints[stalest].lastUsed) {
+      stalest = i;
+    }
+  }
+
+  if (best == endpoints.size()) {
+    // all are ejected, the one coming back first is better than nothing
+    best = static_cast<std::size_t>(std::distance(
+        endpoints.begin(),
+        std::min_element(endpoints.begin(), endpoints.end(),
+                         [](const Endpoint &lhs, const Endpoint &rhs) {
+                           return lhs.ejectedUntil < rhs.ejectedUntil;
+                         })));
+  } else if (best != preferred) {
+    spdlog::info("Switching to endpoint {}: {:.0f}ms, {:.0f}% errors",
+                 endpoints[best].url, endpoints[best].rtt,
+                 endpoints[best].errors * 100);
+    preferred = best;
+  }
+
+  auto chosen = best;
+  if (requests % exploreEvery == 0 && stalest != endpoints.size()) {
+    chosen = stalest;
+  }
+  endpoints[chosen].lastUsed = now;
+  return chosen;
+}
+
+void FailoverClient::record(std::size_t i, clock::duration took,
+                            const model::Err *err) {
+  using std::chrono::duration;
+  using std::chrono::duration_cast;
+
+  // request not sent for lack of time tells nothing about the endpoint
+  if (err != nullptr && err->code == model::Err::deadlineExceeded) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &endpoint = endpoints[i];
+
+  // client errors are answered by a healthy server
+  if (err != nullptr && Retryable(*err)) {
+    endpoint.errors = alpha + (1 - alpha) * endpoint.errors;
+    endpoint.failures++;
+    if (endpoint.failures >= ejectAfter) {
+      auto exponent = std::min(endpoint.failures - ejectAfter, 6);
+      auto ejection = std::min<std::chrono::seconds>(
+          minEjection * (1 << exponent), maxEjection);
+      endpoint.ejectedUntil = clock::now() + ejection;
+      spdlog::warn("Endpoint {} failed {} times in a row, ejected for {}s",
+                   endpoint.url, endpoint.failures, ejection.count());
+    }
+    return;
+  }
+
+  auto ms = duration_cast<duration<double, std::milli>>(took).count();
+  endpoint.rtt = endpoint.measured ? alpha * ms + (1 - alpha) * endpoint.rtt
+                                   : ms;
+  endpoint.measured = true;
+  endpoint.errors = (1 - alpha) * endpoint.errors;
+  endpoint.failures = 0;
+}
+
+template <class T>
+std::variant<model::Err, T> FailoverClient::call(
+    const std::function<std::variant<model::Err, T>(Client &)> &request) {
+  auto i = pick();
+  auto start = clock::now();
+  auto resp = request(*endpoints[i].client);
+  record(i, clock::now() - start, std::get_if<model::Err>(&resp));
+  return resp;
+}
+
+template <class T>
+void FailoverClient::asyncCall(
+    const std::function<void(Client &, Handler<T>)> &request,
+    Handler<T> handler) {
+  auto i = pick();
+  auto start = clock::now();
+  request(*endpoints[i].client,
+          [this, i, start,
+           handler = std::move(handler)](std::variant<model::Err, T> resp) {
+            record(i, clock::now() - start, std::get_if<model::Err>(&resp));
+            handler(std::move(resp));
+          });
+}
+
+model::RegisterResponse FailoverClient::doRegister(Deadline deadline) {
+  return call<model::UserInfo>(
+      [deadline](Client &client) { return client.TryRegister(deadline); });
+}
+
+model::TaskResponse FailoverClient::doGetTask(Deadline deadline) {
+  return call<model::Task>(
+      [deadline](Client &client) { return client.TryGetTask(deadline); });
+}
+
+model::SendAnswerResponse
+FailoverClient::doSendAnswer(const model::Answer &answer, Deadline deadline) {
+  return call<model::AnswerStatus>([&answer, deadline](Client &client) {
+    return client.TrySendAnswer(answer, deadline);
+  });
+}
+
+void FailoverClient::doAsyncRegister(Deadline deadline,
+                                     Handler<model::UserInfo> handler) {
+  asyncCall<model::UserInfo>(
+      [deadline](Client &client, Handler<model::UserInfo> h) {
+        client.AsyncRegister(std::move(h), deadline);
+      },
+      std::move(handler));
+}
+
+void FailoverClient::doAsyncGetTask(Deadline deadline,
+                                    Handler<model::Task> handler) {
+  asyncCall<model::Task>(
+      [deadline](Client &client, Handler<model::Task> h) {
+        client.AsyncGetTask(std::move(h), deadline);
+      },
+      std::move(handler));
+}
+
+void FailoverClient::doAsyncSendAnswer(const model::Answer &answer,
+                                       Deadline deadline,
+                                       Handler<model::AnswerStatus> handler) {
+  asyncCall<model::AnswerStatus>(
+      [&answer, deadline](Client &client, Handler<model::AnswerStatus> h) {
+        client.AsyncSendAnswer(answer, std::move(h), deadline);
+      },
+      std::move(handler));
+}
+
+model::Err FailoverClient::doSubscribe(const TaskCallback &onTask) {
+  auto i = pick();
+  return endpoints[i].client->Subscribe(onTask);
+}
+
+void FailoverClient::doUnsubscribe() {
+  for (auto &endpoint : endpoints) {
+    endpoint.client->Unsubscribe();
+  }
+}
+
+} // namespace crypto
@@ -0,0 +1,93 @@
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "client.hpp"
+#include "models.hpp"
+
+#ifndef FAILOVER_CLIENT_HPP
+#define FAILOVER_CLIENT_HPP
+
+namespace crypto {
+
+// FailoverClient spreads requests over several endpoints of the same pool.
+// Every request goes to the endpoint with the lowest latency weighted by its
+// error rate. Endpoint failing several times in a row is ejected for a growing
+// period, so requests fail over to the next best one. Now and then a request
+// is sent to another endpoint to keep its latency up to date.
+class FailoverClient final : public Client {
+public:
+  using clock = std::chrono::steady_clock;
+  using Factory = std::function<std::unique_ptr<Client>(const std::string &)>;
+
+private:
+  // weight of the new sample in exponential moving averages
+  static constexpr double alpha = 0.2;
+  // latency is multiplied by 1 + errorPenalty * error rate
+  static constexpr double errorPenalty = 4;
+  // failures in a row before the endpoint is ejected
+  static constexpr int ejectAfter = 3;
+  static constexpr std::chrono::seconds minEjection{5};
+  static constexpr std::chrono::seconds maxEjection{300};
+  // every exploreEvery request goes to the least recently used endpoint
+  static constexpr std::size_t exploreEvery = 20;
+
+  struct Endpoint {
+    std::string url;
+    std::unique_ptr<Client> client;
+    // moving averages of request latency in milliseconds and failures share
+    double rtt = 0;
+    bool measured = false;
+    double errors = 0;
+    int failures = 0;
+    clock::time_point ejectedUntil;
+    clock::time_point lastUsed;
+  };
+
+  std::mutex mutex;
+  std::vector<Endpoint> endpoints;
+  std::size_t requests = 0;
+  // best endpoint, its change is logged
+  std::size_t preferred = 0;
+
+public:
+  FailoverClient(const std::vector<std::string> &urls, const Factory &factory);
+  ~FailoverClient() final = default;
+
+private:
+  double score(const Endpoint &endpoint) const;
+  // Returns index of the endpoint for the next request
+  std::size_t pick();
+  // NOTE: err is null if request succeeded
+  void record(std::size_t i, clock::duration took, const model::Err *err);
+
+  template <class T>
+  std::variant<model::Err, T>
+  call(const std::function<std::variant<model::Err, T>(Client &)> &request);
+  template <class T>
+  void asyncCall(const std::function<void(Client &, Handler<T>)> &request,
+                 Handler<T> handler);
+
+  model::RegisterResponse doRegister(Deadline deadline) final;
+  model::TaskResponse doGetTask(Deadline deadline) final;
+  model::SendAnswerResponse doSendAnswer(const model::Answer &answer,
+                                         Deadline deadline) final;
+
+  void doAsyncRegister(Deadline deadline,
+                       Handler<model::UserInfo> handler) final;
+  void doAsyncGetTask(Deadline deadline, Handler<model::Task> handler) final;
+  void doAsyncSendAnswer(const model::Answer &answer, Deadline deadline,
+                         Handler<model::AnswerStatus> handler) final;
+
+  // Task channel is opened to the best endpoint at the moment
+  model::Err doSubscribe(const TaskCallback &onTask) final;
+  void doUnsubscribe() final;
+};
+
+} // namespace crypto
+
+#endif
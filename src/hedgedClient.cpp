@@ -0,0 +1,182 @@
+#include "hedgedClient.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <utility>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+HedgedClient::HedgedClient(std::unique_ptr<Client> _client,
+                           boost::asio::io_context &_ioc, double _percentile)
+    : client(std::move(_client)), ioc(_ioc), percentile(_percentile),
+      budgetStarted(clock::now()) {}
+
+void HedgedClient::Stop() {
+  std::lock_guard<std::mutex> lock(mutex);
+  stopped = true;
+  for (auto &timer : timers) {
+    timer->cancel();
+  }
+}
+
+std::optional<HedgedClient::clock::duration> HedgedClient::delay() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (stopped || samples.size() < minSamples) {
+    return std::nullopt;
+  }
+  std::vector<clock::duration> sorted(samples.begin(), samples.end());
+  auto rank = static_cast<long>(
+      std::ceil(percentile / 100 * static_cast<double>(sorted.size())));
+  auto nth = sorted.begin() + std::max(rank, 1L) - 1;
+  std::nth_element(sorted.begin(), nth, sorted.end());
+  return std::max<clock::duration>(*nth, minDelay);
+}
+
+bool HedgedClient::spend() {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto now = clock::now();
+  if (now - budgetStarted >= budgetInterval) {
+    budgetStarted = now;
+    hedges = 0;
+  }
+  if (hedges >= maxHedges) {
+    return false;
+  }
+  hedges++;
+  return true;
+}
+
+void HedgedClient::learn(clock::duration took) {
+  std::lock_guard<std::mutex> lock(mutex);
+  samples.push_back(took);
+  if (samples.size() > window) {
+    samples.pop_front();
+  }
+}
+
+void HedgedClient::launch(const std::shared_ptr<Race> &race,
+                          Deadline deadline, bool hedge) {
+  {
+    std::lock_guard<std::mutex> lock(race->mutex);
+    race->pending++;
+  }
+  client->AsyncGetTask(
+      [this, race, hedge](model::TaskResponse resp) {
+        Handler<model::Task> handler;
+        {
+          std::lock_guard<std::mutex> lock(race->mutex);
+          race->pending--;
+          // failed one waits for the other, it may still succeed
+          if (race->done || (std::holds_alternative<model::Err>(resp) &&
+                             race->pending > 0)) {
+            return;
+          }
+          race->done = true;
+          handler = std::move(race->handler);
+        }
+        if (std::holds_alternative<model::Task>(resp)) {
+          learn(clock::now() - race->started);
+          if (hedge) {
+            spdlog::debug("Hedged task request won");
+          }
+        }
+        handler(std::move(resp));
+      },
+      deadline);
+}
+
+model::RegisterResponse HedgedClient::doRegister(Deadline deadline) {
+  return client->TryRegister(deadline);
+}
+
+model::TaskResponse HedgedClient::doGetTask(Deadline deadline) {
+  if (!delay()) {
+    auto start = clock::now();
+    auto resp = client->TryGetTask(deadline);
+    if (std::holds_alternative<model::Task>(resp)) {
+      learn(clock::now() - start);
+    }
+    return resp;
+  }
+
+  auto promise = std::make_shared<std::promise<model::TaskResponse>>();
+  auto future = promise->get_future();
+  doAsyncGetTask(deadline, [promise](model::TaskResponse resp) {
+    promise->set_value(std::move(resp));
+  });
+  return future.get();
+}
+
+model::SendAnswerResponse
+HedgedClient::doSendAnswer(const model::Answer &answer, Deadline deadline) {
+  return client->TrySendAnswer(answer, deadline);
+}
+
+void HedgedClient::doAsyncRegister(Deadline deadline,
+                                   Handler<model::UserInfo> handler) {
+  client->AsyncRegister(std::move(handler), deadline);
+}
+
+void HedgedClient::doAsyncGetTask(Deadline deadline,
+                                  Handler<model::Task> handler) {
+  auto race = std::make_shared<Race>();
+  race->handler = std::move(handler);
+  race->started = clock::now();
+
+  auto wait = delay();
+  if (!wait) {
+    launch(race, deadline, false);
+    return;
+  }
+
+  auto timer = std::make_shared<boost::asio::steady_timer>(ioc, *wait);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    timers.insert(timer);
+  }
+  launch(race, deadline, false);
+  timer->async_wait(
+      [this, race, deadline, timer](const boost::system::error_code &ec) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          timers.erase(timer);
+        }
+        if (ec) {
+          return;
+        }
+        {
+          std::lock_guard<std::mutex> lock(race->mutex);
+          if (race->done) {
+            return;
+          }
+        }
+        // too late for a hedge to win
+        if (std::chrono::system_clock::now() >= deadline) {
+          return;
+        }
+        if (!spend()) {
+          spdlog::debug("Hedge budget is exhausted, not hedging");
+          return;
+        }
+        spdlog::debug("Task request is slow, hedging it");
+        launch(race, deadline, true);
+      });
+}
+
+void HedgedClient::doAsyncSendAnswer(const model::Answer &answer,
+                                     Deadline deadline,
+                                     Handler<model::AnswerStatus> handler) {
+  client->AsyncSendAnswer(answer, std::move(handler), deadline);
+}
+
+model::Err HedgedClient::doSubscribe(const TaskCallback &onTask) {
+  return client->Subscribe(onTask);
+}
+
+void HedgedClient::doUnsubscribe() { client->Unsubscribe(); }
+
+} // namespace crypto
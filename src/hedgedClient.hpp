@@ -0,0 +1,98 @@
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+
+#include "boost/asio/io_context.hpp"
+#include "boost/asio/steady_timer.hpp"
+
+#include "client.hpp"
+#include "models.hpp"
+
+#ifndef HEDGED_CLIENT_HPP
+#define HEDGED_CLIENT_HPP
+
+namespace crypto {
+
+// HedgedClient cuts the tail latency of task fetching. Task request not
+// answered within the given percentile of recent fetch times is sent once
+// more, the wrapped client takes another connection or endpoint for it, and
+// the first answer wins. Hedges are limited per interval, so a slow server
+// doesn't get twice the load. Other requests are passed as is.
+class HedgedClient final : public Client {
+public:
+  using clock = std::chrono::steady_clock;
+
+private:
+  // fetch times of so many recent tasks are learnt from
+  static constexpr std::size_t window = 100;
+  // no hedges until there are enough samples
+  static constexpr std::size_t minSamples = 20;
+  // hedge is never sent sooner, fast fetches vary just by noise
+  static constexpr std::chrono::milliseconds minDelay{50};
+  // at most maxHedges hedges per budgetInterval
+  static constexpr int maxHedges = 10;
+  static constexpr std::chrono::minutes budgetInterval{1};
+
+  // Race of the request and its hedge, handler is called by the first answer
+  struct Race {
+    std::mutex mutex;
+    Handler<model::Task> handler;
+    clock::time_point started;
+    int pending = 0;
+    bool done = false;
+  };
+
+  std::unique_ptr<Client> client;
+  // hedges are sent by its timers
+  boost::asio::io_context &ioc;
+  const double percentile;
+
+  std::mutex mutex;
+  std::deque<clock::duration> samples;
+  clock::time_point budgetStarted;
+  int hedges = 0;
+  bool stopped = false;
+  // hedge timers, cancelled by Stop
+  std::set<std::shared_ptr<boost::asio::steady_timer>> timers;
+
+public:
+  // percentile is in (0, 100)
+  HedgedClient(std::unique_ptr<Client> _client, boost::asio::io_context &_ioc,
+               double _percentile);
+  ~HedgedClient() final = default;
+
+  // Stops sending hedges, pending requests are still answered.
+  // NOTE: io_context must be running, so cancelled timers are handled
+  void Stop();
+
+private:
+  // Returns time to wait before hedging, nullopt if there is no estimate yet
+  std::optional<clock::duration> delay();
+  // Takes a hedge from the budget, returns false if there is none left
+  bool spend();
+  void learn(clock::duration took);
+  void launch(const std::shared_ptr<Race> &race, Deadline deadline,
+              bool hedge);
+
+  model::RegisterResponse doRegister(Deadline deadline) final;
+  model::TaskResponse doGetTask(Deadline deadline) final;
+  model::SendAnswerResponse doSendAnswer(const model::Answer &answer,
+                                         Deadline deadline) final;
+
+  void doAsyncRegister(Deadline deadline,
+                       Handler<model::UserInfo> handler) final;
+  void doAsyncGetTask(Deadline deadline, Handler<model::Task> handler) final;
+  void doAsyncSendAnswer(const model::Answer &answer, Deadline deadline,
+                         Handler<model::AnswerStatus> handler) final;
+
+  model::Err doSubscribe(const TaskCallback &onTask) final;
+  void doUnsubscribe() final;
+};
+
+} // namespace crypto
+
+#endif
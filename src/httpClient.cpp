@@ -1,19 +1,36 @@
 #include "httpClient.hpp"
+#include "decoder.hpp"
 #include "models.hpp"
 
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cctype>
+#include <condition_variable>
+#include <ctime>
 #include <exception>
+#include <fstream>
+#include <functional>
 #include <iterator>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
+#include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
+
+#include <poll.h>
+#include <zlib.h>
 
-#define CPPHTTPLIB_OPENSSL_SUPPORT
 #include "httplib.h"
+#include "openssl/ssl.h"
 
+#include "boost/asio/post.hpp"
+#include "boost/asio/thread_pool.hpp"
+#include "boost/core/ignore_unused.hpp"
+#include "boost/filesystem.hpp"
 #include "fmt/core.h"
 #include "nlohmann/json_fwd.hpp"
 #include "spdlog/spdlog.h"
@@ -40,21 +57,324 @@ model::Err exceptionToErr() {
 }
 } // namespace
 
+namespace {
+// SessionCache keeps the latest TLS session of the server, so a new
+// connection resumes it instead of doing a full handshake. If there is a file
+// for it, the session is saved there and loaded on start, so the first
+// connection after restart is resumed as well.
+class SessionCache {
+private:
+  // saved session is not loaded if older, even if the server would take it
+  static constexpr long maxAge = 12 * 60 * 60;
+
+  std::mutex mutex;
+  SSL_SESSION *session = nullptr;
+  // empty if session is not saved
+  const boost::filesystem::path path;
+
+  void load() {
+    boost::system::error_code ec;
+    if (path.empty() || !boost::filesystem::exists(path, ec)) {
+      return;
+    }
+    std::ifstream in(path.string(), std::ios::binary);
+    std::string der((std::istreambuf_iterator<char>(in)),
+                    std::istreambuf_iterator<char>());
+    const auto *data = reinterpret_cast<const unsigned char *>(der.data());
+    auto *loaded =
+        d2i_SSL_SESSION(nullptr, &data, static_cast<long>(der.size()));
+    if (loaded == nullptr) {
+      spdlog::warn("TLS session file {} is broken, removing it",
+                   path.string());
+      boost::filesystem::remove(path, ec);
+      return;
+    }
+
+    auto age = std::time(nullptr) - SSL_SESSION_get_time(loaded);
+    auto lifetime = std::min(SSL_SESSION_get_timeout(loaded), maxAge);
+    if (age >= lifetime || SSL_SESSION_is_resumable(loaded) == 0) {
+      spdlog::debug("TLS session saved {}s ago has expired", age);
+      SSL_SESSION_free(loaded);
+      boost::filesystem::remove(path, ec);
+      return;
+    }
+    spdlog::info("Loaded TLS session saved {}s ago", age);
+    session = loaded;
+  }
+
+  // NOTE: must be called with locked mutex
+  void save() {
+    auto size = i2d_SSL_SESSION(session, nullptr);
+    if (size <= 0) {
+      return;
+    }
+    std::string der(static_cast<std::size_t>(size), '\0');
+    auto *data = reinterpret_cast<unsigned char *>(der.data());
+    i2d_SSL_SESSION(session, &data);
+
+    // session holds the keys, so nobody else may read the file, and it is
+    // replaced at once, so a crash doesn't leave it half-written
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(path.parent_path(), ec);
+    auto tmp = path;
+    tmp += ".tmp";
+    {
+      std::ofstream out(tmp.string(), std::ios::binary | std::ios::trunc);
+      boost::filesystem::permissions(tmp,
+                                     boost::filesystem::owner_read |
+                                         boost::filesystem::owner_write,
+                                     ec);
+      out.write(der.data(), static_cast<std::streamsize>(der.size()));
+      if (!out || ec) {
+        spdlog::warn("Can`t save TLS session to {}", tmp.string());
+        return;
+      }
+    }
+    boost::filesystem::rename(tmp, path, ec);
+    if (ec) {
+      spdlog::warn("Can`t save TLS session to {}: {}", path.string(),
+                   ec.message());
+    }
+  }
+
+public:
+  explicit SessionCache(boost::filesystem::path _path)
+      : path(std::move(_path)) {
+    load();
+  }
+  ~SessionCache() {
+    if (session != nullptr) {
+      SSL_SESSION_free(session);
+    }
+  }
+
+  SessionCache(SessionCache &) = delete;
+  SessionCache(SessionCache &&) = delete;
+
+  SessionCache &operator=(SessionCache &) = delete;
+  SessionCache &operator=(SessionCache &&) = delete;
+
+  // Takes ownership of the session reference, the file is rewritten only if
+  // persist is set
+  void Store(SSL_SESSION *fresh, bool persist) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (session != nullptr) {
+      SSL_SESSION_free(session);
+    }
+    session = fresh;
+    if (persist && !path.empty()) {
+      save();
+    }
+  }
+
+  void Apply(SSL *ssl) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (session != nullptr) {
+      SSL_set_session(ssl, session);
+    }
+  }
+};
+
+// Connection is one kept-alive server connection of the pool
+struct Connection {
+  httplib::Client client;
+  SessionCache &sessions;
+  std::chrono::steady_clock::time_point lastUsed;
+
+  // set by socket and TLS callbacks while a new connection is established
+  httplib::socket_t sock = -1;
+  bool connecting = false;
+  // TLS 1.3 server sends several session tickets per handshake, the first
+  // one is saved to the file, the rest only replace it in memory
+  bool sessionSaved = false;
+  std::chrono::steady_clock::time_point connectStarted;
+  std::chrono::steady_clock::time_point handshakeStarted;
+  HTTPClient::Timing timing;
+
+  Connection(std::string_view url, SessionCache &_sessions)
+      : client(url.data()), sessions(_sessions) {}
+};
+
+Connection &connectionOf(const SSL *ssl) {
+  auto *ctx = SSL_get_SSL_CTX(ssl);
+  return *static_cast<Connection *>(SSL_CTX_get_app_data(ctx));
+}
+
+int onNewSession(SSL *ssl, SSL_SESSION *session) {
+  auto &conn = connectionOf(ssl);
+  conn.sessions.Store(session, !conn.sessionSaved);
+  conn.sessionSaved = true;
+  // reference is kept by the cache
+  return 1;
+}
+
+void onInfo(const SSL *ssl, int where, int ret) {
+  boost::ignore_unused(ret);
+  auto &conn = connectionOf(ssl);
+  if (!conn.connecting) {
+    return;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if ((where & SSL_CB_HANDSHAKE_START) != 0) {
+    conn.handshakeStarted = now;
+    conn.timing.connect = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - conn.connectStarted);
+    // httplib 0.9 has no hook between SSL_new and SSL_connect, so session is
+    // set here: SSL_connect reports the start before ClientHello is built.
+    // Resumption after restart is covered by tests.
+    conn.sessions.Apply(const_cast<SSL *>(ssl));
+  }
+  if ((where & SSL_CB_HANDSHAKE_DONE) != 0) {
+    conn.connecting = false;
+    conn.timing.handshake =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            now - conn.handshakeStarted);
+    conn.timing.resumed = SSL_session_reused(const_cast<SSL *>(ssl)) == 1;
+  }
+}
+
+// EventStream parses server-sent events of the task channel: every event
+// carries a task json in its data, comments are heartbeats
+class EventStream {
+private:
+  const Client::TaskCallback &onTask;
+  std::string buffer;
+  std::string event;
+  std::string data;
+
+  void dispatch() {
+    if (data.empty() || (!event.empty() && event != "task")) {
+      event.clear();
+      data.clear();
+      return;
+    }
+    auto decoded = model::Decode<model::Task>(data);
+    if (auto *task = std::get_if<model::Task>(&decoded)) {
+      spdlog::debug("Task pushed: {}", *task);
+      onTask(*task);
+    } else {
+      spdlog::warn("Can`t parse pushed task: {}",
+                   std::get<model::Err>(decoded).msg);
+    }
+    event.clear();
+    data.clear();
+  }
+
+  void line(std::string_view l) {
+    if (l.empty()) {
+      dispatch();
+      return;
+    }
+    if (l.front() == ':') {
+      return;
+    }
+    auto colon = l.find(':');
+    auto field = l.substr(0, colon);
+    auto value = colon == std::string_view::npos ? std::string_view()
+                                                 : l.substr(colon + 1);
+    if (!value.empty() && value.front() == ' ') {
+      value.remove_prefix(1);
+    }
+    if (field == "event") {
+      event = value;
+    } else if (field == "data") {
+      if (!data.empty()) {
+        data += '\n';
+      }
+      data += value;
+    }
+  }
+
+public:
+  explicit EventStream(const Client::TaskCallback &_onTask)
+      : onTask(_onTask) {}
+
+  void Feed(const char *chunk, std::size_t size) {
+    buffer.append(chunk, size);
+    std::size_t start = 0;
+    for (auto end = buffer.find('\n'); end != std::string::npos;
+         end = buffer.find('\n', start)) {
+      std::string_view l(buffer.data() + start, end - start);
+      if (!l.empty() && l.back() == '\r') {
+        l.remove_suffix(1);
+      }
+      line(l);
+      start = end + 1;
+    }
+    buffer.erase(0, start);
+  }
+};
+} // namespace
+
 class HTTPClient::HTTPClientImpl {
 private:
-  httplib::SSLClient client;
+  // servers usually close kept-alive connections idle for a minute or so,
+  // reusing older ones is likely to fail
+  static constexpr std::chrono::seconds maxIdle{30};
+  // task channel with no heartbeats for so long is considered broken
+  static constexpr std::chrono::seconds heartbeatTimeout{60};
+  // request with less time left is still tried, but with this timeout
+  static constexpr std::chrono::microseconds minTimeout{100000};
+
+  // with scheme, httplib::Client goes over TLS or plain http by it
+  std::string url;
   std::string token;
+  const model::Compression compression;
+  SessionCache sessions;
 
-public:
-  using Response = std::variant<model::Err, model::Ok>;
+  // httplib client is not safe to be used from several threads at once, so
+  // every request takes a connection of its own from the pool
+  std::mutex mutex;
+  std::condition_variable released;
+  std::vector<std::unique_ptr<Connection>> idle;
+  std::size_t created = 0;
+  const std::size_t poolSize;
+  Timing lastTiming;
+  Traffic traffic;
 
-  explicit HTTPClientImpl(std::string_view url, std::string_view _token)
-      : client(url.data()), token(_token) {
-    client.set_default_headers({
-        {"accept", "application/json"},
-    });
+  // the last task fetched, returned as is while the server has no other
+  std::mutex taskMutex;
+  std::optional<model::Task> lastTask;
+  std::string lastBody;
+  std::string lastTag;
+
+  // answers queued while a submission is in flight, sent together after it
+  struct Queued {
+    model::Answer answer;
+    Deadline deadline;
+    Handler<model::AnswerStatus> handler;
   };
-  ~HTTPClientImpl() = default;
+  // server support of batched answers is learnt from the first batch
+  enum class Batching { unknown, supported, unsupported };
+  std::mutex answersMutex;
+  std::vector<Queued> answers;
+  bool flushing = false;
+  Batching batching = Batching::unknown;
+
+  // task channel has a connection of its own, as it is held open for long
+  std::mutex channelMutex;
+  httplib::Client *channel = nullptr;
+  bool unsubscribed = false;
+
+  // asynchronous requests are run by workers, one per pooled connection
+  boost::asio::thread_pool workers;
+
+public:
+  HTTPClientImpl(std::string_view _url, std::string_view _token,
+                 std::size_t _poolSize, model::Compression _compression,
+                 const boost::filesystem::path &sessionDir)
+      : url(normalize(_url)), token(_token), compression(_compression),
+        sessions(sessionFile(sessionDir, url)),
+        poolSize(std::max<std::size_t>(_poolSize, 1)), workers(poolSize) {}
+  // requests in flight refer to this
+  ~HTTPClientImpl() {
+    workers.join();
+    spdlog::info("{}: sent {} bytes ({} uncompressed), received {} bytes ({} "
+                 "uncompressed) and {} responses of unknown size",
+                 url, traffic.sent, traffic.sentRaw, traffic.received,
+                 traffic.receivedRaw, traffic.unsized);
+  }
 
   HTTPClientImpl(HTTPClientImpl &) = delete;
   HTTPClientImpl(HTTPClientImpl &&) = delete;
@@ -62,16 +382,266 @@ public:
   HTTPClientImpl &operator=(HTTPClientImpl &) = delete;
   HTTPClientImpl &operator=(HTTPClientImpl &&) = delete;
 
+  void Post(std::function<void()> request) {
+    boost::asio::post(workers, [request = std::move(request)]() {
+      try {
+        request();
+      } catch (std::exception &e) {
+        spdlog::error("Request handler thrown: {}", e.what());
+      } catch (...) {
+        spdlog::error("Request handler thrown unknown exception");
+      }
+    });
+  }
+
+  Timing LastTiming() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return lastTiming;
+  }
+
+  Traffic Transferred() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return traffic;
+  }
+
 private:
-  template <int I>
-  static Response processResponse(httplib::Result &res,
-                                  std::array<int, I> expected) {
+  // url without scheme is https, as the pool server is
+  static std::string normalize(std::string_view url) {
+    if (url.find("://") == std::string_view::npos) {
+      return fmt::format("https://{}", url);
+    }
+    return std::string(url);
+  }
+
+  // Every endpoint has a session file of its own, named after its url
+  static boost::filesystem::path
+  sessionFile(const boost::filesystem::path &dir, std::string_view url) {
+    if (dir.empty()) {
+      return {};
+    }
+    std::string name(url);
+    std::replace_if(
+        name.begin(), name.end(),
+        [](char c) { return std::isalnum(static_cast<unsigned char>(c)) == 0; },
+        '_');
+    return dir / (name + ".session");
+  }
+
+  std::unique_ptr<Connection> connect() {
+    auto conn = std::make_unique<Connection>(url, sessions);
+    auto &client = conn->client;
+    client.set_default_headers({
+        {"accept", "application/json"},
+        {"accept-encoding", compression == model::Compression::off
+                                ? "identity"
+                                : "gzip, deflate"},
+    });
+    client.set_decompress(compression != model::Compression::off);
+    client.set_keep_alive(true);
+    client.set_tcp_nodelay(true);
+
+    auto *raw = conn.get();
+    client.set_socket_options([raw](httplib::socket_t sock) {
+      raw->sock = sock;
+      raw->connecting = true;
+      raw->connectStarted = std::chrono::steady_clock::now();
+      raw->sessionSaved = false;
+      raw->timing = Timing{};
+      raw->timing.reused = false;
+    });
+
+    auto *ctx = client.ssl_context();
+    if (ctx == nullptr) {
+      // plain http
+      return conn;
+    }
+    SSL_CTX_set_app_data(ctx, raw);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+                                            SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ctx, onNewSession);
+    SSL_CTX_set_info_callback(ctx, onInfo);
+    return conn;
+  }
+
+  // Idle kept-alive connection must have nothing to read: readable socket
+  // means the server closed it or sent garbage, either way it is unusable
+  static bool healthy(const Connection &conn) {
+    if (conn.client.is_socket_open() == 0) {
+      // nothing to check, next request connects anew
+      return true;
+    }
+    if (std::chrono::steady_clock::now() - conn.lastUsed > maxIdle) {
+      return false;
+    }
+    pollfd fd{conn.sock, POLLIN, 0};
+    return ::poll(&fd, 1, 0) == 0;
+  }
+
+  std::unique_ptr<Connection> acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    released.wait(lock,
+                  [this]() { return !idle.empty() || created < poolSize; });
+    if (idle.empty()) {
+      ++created;
+      lock.unlock();
+      try {
+        return connect();
+      } catch (...) {
+        lock.lock();
+        --created;
+        released.notify_one();
+        throw;
+      }
+    }
+
+    // the most recently used connection is the likeliest to be alive
+    auto conn = std::move(idle.back());
+    idle.pop_back();
+    lock.unlock();
+    if (!healthy(*conn)) {
+      spdlog::debug("Closing stale server connection");
+      conn->client.stop();
+    }
+    return conn;
+  }
+
+  void release(std::unique_ptr<Connection> conn) {
+    conn->lastUsed = std::chrono::steady_clock::now();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      lastTiming = conn->timing;
+      idle.push_back(std::move(conn));
+    }
+    released.notify_one();
+  }
+
+  static std::optional<model::Err> exceeded(Deadline deadline) {
+    if (std::chrono::system_clock::now() < deadline) {
+      return std::nullopt;
+    }
+    return model::Err{std::nullopt, model::Err::deadlineExceeded,
+                      "deadline exceeded"};
+  }
+
+  // Sets timeouts, so the request ends by the deadline: connect may take a
+  // half of the time left, every read or write may take all of it. httplib
+  // timeouts are per operation, so the deadline is kept approximately.
+  static void limit(httplib::Client &client, Deadline deadline) {
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    using std::chrono::seconds;
+
+    auto left = std::max(duration_cast<microseconds>(
+                             deadline - std::chrono::system_clock::now()),
+                         minTimeout);
+    auto split = [](microseconds timeout) {
+      auto sec = duration_cast<seconds>(timeout);
+      return std::make_pair(sec.count(), (timeout - sec).count());
+    };
+    auto [connectSec, connectUsec] = split(left / 2);
+    auto [sec, usec] = split(left);
+    client.set_connection_timeout(connectSec, connectUsec);
+    client.set_read_timeout(sec, usec);
+    client.set_write_timeout(sec, usec);
+  }
+
+  // Sends request over a pooled connection. Idempotent one is resent once on
+  // a new connection if the kept-alive one turned out to be broken.
+  template <typename F>
+  httplib::Result send(std::string_view path, bool idempotent,
+                       Deadline deadline, F &&request) {
+    auto conn = acquire();
+    conn->timing = Timing{};
+    limit(conn->client, deadline);
+    auto res = request(conn->client);
+    if (!res && idempotent && conn->timing.reused && !exceeded(deadline)) {
+      spdlog::debug("Kept-alive connection failed, reconnecting");
+      conn->client.stop();
+      limit(conn->client, deadline);
+      res = request(conn->client);
+    }
+
+    const auto &timing = conn->timing;
+    // NOTE: query is not logged, as it holds the token
+    auto target = path.substr(0, path.find('?'));
+    if (timing.reused) {
+      spdlog::debug("{}: kept-alive connection reused", target);
+    } else {
+      spdlog::debug("{}: connected in {}us, TLS handshake in {}us ({})",
+                    target, timing.connect.count(), timing.handshake.count(),
+                    timing.resumed ? "resumed" : "full");
+    }
+    release(std::move(conn));
+    return res;
+  }
+
+private:
+  // Compresses body into zlib format, which deflate content encoding is
+  static std::optional<std::string> deflated(const std::string &body) {
+    auto size = compressBound(body.size());
+    std::string out(size, '\0');
+    auto rc = compress2(reinterpret_cast<Bytef *>(out.data()), &size,
+                        reinterpret_cast<const Bytef *>(body.data()),
+                        body.size(), Z_BEST_COMPRESSION);
+    if (rc != Z_OK) {
+      spdlog::warn("Can`t compress request, sending it as is: {}", rc);
+      return std::nullopt;
+    }
+    out.resize(size);
+    return out;
+  }
+
+  // Adds request and response body sizes to the traffic. Response body is
+  // already decompressed, so its wire size is the content length. Compressed
+  // response without one is chunked, its wire size is not known.
+  void account(std::string_view path, std::size_t sent, std::size_t sentRaw,
+               const httplib::Result &res) {
+    std::optional<std::size_t> received = 0;
+    std::size_t receivedRaw = 0;
+    if (res) {
+      receivedRaw = res->body.size();
+      auto encoding = res->get_header_value("content-encoding");
+      if (res->has_header("content-length")) {
+        try {
+          received = std::stoul(res->get_header_value("content-length"));
+        } catch (std::exception &) {
+          received = std::nullopt;
+        }
+      } else if (encoding.empty() || encoding == "identity") {
+        received = receivedRaw;
+      } else {
+        received = std::nullopt;
+      }
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      traffic.sent += sent;
+      traffic.sentRaw += sentRaw;
+      if (received) {
+        traffic.received += received.value();
+        traffic.receivedRaw += receivedRaw;
+      } else {
+        traffic.unsized++;
+      }
+    }
+    // NOTE: query is not logged, as it holds the token
+    spdlog::debug("{}: sent {} bytes ({} uncompressed), received {} bytes ({} "
+                  "uncompressed)",
+                  path.substr(0, path.find('?')), sent, sentRaw,
+                  received ? std::to_string(received.value()) : "unknown",
+                  receivedRaw);
+  }
+
+  // Checks response status and decodes its body straight into T
+  template <class T, int I>
+  static std::variant<model::Err, T>
+  processResponse(httplib::Result &res, std::array<int, I> expected) {
     if (!res) {
       auto err = res.error();
       std::stringstream ss;
       ss << err;
 
-      return model::Err{std::nullopt, -1, ss.str()};
+      return model::Err{std::nullopt, model::Err::transport, ss.str()};
     }
 
     if (std::none_of(expected.begin(), expected.end(),
@@ -83,111 +653,391 @@ private:
       return ret;
     }
 
-    // TODO: check this string -> json conversion about safety/exceptions and so
-    return model::Ok{nlohmann::json::parse(res->body)};
+    return model::Decode<T>(res->body);
   }
 
 public:
-  Response Get(std::string_view request) {
+  template <class T>
+  std::variant<model::Err, T> Get(std::string_view request,
+                                  Deadline deadline) {
+    if (auto err = exceeded(deadline)) {
+      return err.value();
+    }
     try {
-      auto res = client.Get(request.data());
-      return processResponse<1>(res, {200});
+      auto res =
+          send(request, true, deadline, [&request](httplib::Client &client) {
+            return client.Get(request.data());
+          });
+      account(request, 0, 0, res);
+      return processResponse<T, 1>(res, {200});
     } catch (...) {
       return exceptionToErr();
     };
   }
 
-  model::RegisterResponse Register() {
+  model::RegisterResponse Register(Deadline deadline) {
     std::string request = fmt::format("/api/v1/register?auth_token={}", token);
-    auto res = Get(request);
+    return Get<model::UserInfo>(request, deadline);
+  }
+
+  // Task mostly stays the same between polls, so unchanged one is not decoded:
+  // server is asked for it with the ETag of the last one, and a body equal to
+  // the last one is recognized by comparison
+  model::TaskResponse GetTask(Deadline deadline) {
+    if (auto err = exceeded(deadline)) {
+      return err.value();
+    }
+    try {
+      std::string request = fmt::format("/api/v1/task?auth_token={}", token);
+      httplib::Headers headers;
+      {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        if (!lastTag.empty()) {
+          headers.emplace("if-none-match", lastTag);
+        }
+      }
+      auto res = send(request, true, deadline,
+                      [&request, &headers](httplib::Client &client) {
+                        return client.Get(request.c_str(), headers);
+                      });
+      account(request, 0, 0, res);
+      if (!res || (res->status != 200 && res->status != 304)) {
+        return processResponse<model::Task, 1>(res, {200});
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        if (res->status == 304) {
+          if (!lastTask) {
+            return model::Err{std::nullopt, 304,
+                              "task is not modified, but there is none"};
+          }
+          spdlog::debug("Task is not modified");
+          return lastTask.value();
+        }
+        if (lastTask && res->body == lastBody) {
+          spdlog::debug("Task is the same");
+          lastTag = res->get_header_value("etag");
+          return lastTask.value();
+        }
+      }
 
-    model::RegisterResponse resp;
-    std::visit(
-        model::util::overload{[&resp](const model::Err &err) { resp = err; },
-                              [&resp](const model::Ok &ok) { resp = ok.body; }},
-        res);
-    return resp;
+      auto resp = processResponse<model::Task, 1>(res, {200});
+      if (auto *task = std::get_if<model::Task>(&resp)) {
+        std::lock_guard<std::mutex> lock(taskMutex);
+        lastTask = *task;
+        lastBody = std::move(res->body);
+        lastTag = res->get_header_value("etag");
+      }
+      return resp;
+    } catch (...) {
+      return exceptionToErr();
+    }
   }
 
-  model::TaskResponse GetTask() {
-    std::string request = fmt::format("/api/v1/task?auth_token={}", token);
-    auto res = Get(request);
+  model::Err Subscribe(const TaskCallback &onTask) {
+    try {
+      httplib::Client client(url);
+      // server sends heartbeats, so silent channel is a broken one
+      client.set_read_timeout(heartbeatTimeout.count());
+      client.set_tcp_nodelay(true);
+      {
+        std::lock_guard<std::mutex> lock(channelMutex);
+        if (unsubscribed) {
+          return model::Err{std::nullopt, 0, "unsubscribed"};
+        }
+        channel = &client;
+      }
+
+      std::string path =
+          fmt::format("/api/v1/task/subscribe?auth_token={}", token);
+      EventStream stream(onTask);
+      spdlog::info("Subscribing to tasks");
+      // compressing server would hold events back to fill its buffers
+      auto res = client.Get(path.c_str(),
+                            {{"accept", "text/event-stream"},
+                             {"accept-encoding", "identity"}},
+                            [&stream](const char *data, std::size_t size) {
+                              stream.Feed(data, size);
+                              return true;
+                            });
+      {
+        std::lock_guard<std::mutex> lock(channelMutex);
+        channel = nullptr;
+        if (unsubscribed) {
+          return model::Err{std::nullopt, 0, "unsubscribed"};
+        }
+      }
+
+      if (!res) {
+        std::stringstream ss;
+        ss << res.error();
+        return model::Err{std::nullopt, model::Err::transport, ss.str()};
+      }
+      if (res->status != 200) {
+        return model::Err{std::nullopt, res->status,
+                          "server refused subscription"};
+      }
+      return model::Err{std::nullopt, -1, "server closed task channel"};
+    } catch (...) {
+      return exceptionToErr();
+    }
+  }
 
-    model::TaskResponse resp;
-    std::visit(
-        model::util::overload{[&resp](const model::Err &err) { resp = err; },
-                              [&resp](const model::Ok &ok) { resp = ok.body; }},
-        res);
-    return resp;
+  void Unsubscribe() {
+    std::lock_guard<std::mutex> lock(channelMutex);
+    unsubscribed = true;
+    if (channel != nullptr) {
+      channel->stop();
+    }
   }
 
-  model::SendAnswerResponse SendAnswer(const model::Answer &a) {
+  model::SendAnswerResponse SendAnswer(const model::Answer &a,
+                                       Deadline deadline) {
+    // answer reaching the server after the task expired is useless
+    if (auto err = exceeded(deadline)) {
+      return err.value();
+    }
     try {
       std::string path =
           fmt::format("/api/v1/send_answer?auth_token={}", token);
       nlohmann::json request = a;
-      spdlog::debug("Sending answer: {}", request.dump());
-      auto res = client.Post(path.c_str(), request.dump(), "application/json");
-      auto processed = processResponse<3>(res, {200, 202, 400});
-
-      model::SendAnswerResponse resp;
-      std::visit(model::util::overload{
-                     [&resp](const model::Err &err) { resp = err; },
-                     [&resp](const model::Ok &ok) { resp = ok.body; }},
-                 processed);
-      return resp;
-      ;
+      auto body = request.dump();
+      spdlog::debug("Sending answer: {}", body);
+      auto res = post(path, std::move(body), deadline);
+      return processResponse<model::AnswerStatus, 3>(res, {200, 202, 400});
     } catch (...) {
       return exceptionToErr();
     }
   }
+
+  // Queues answer for submission. Answers queued while another submission is
+  // in flight are sent in one batch after it, if the server takes batches.
+  void AsyncSendAnswer(model::Answer answer, Deadline deadline,
+                       Handler<model::AnswerStatus> handler) {
+    {
+      std::lock_guard<std::mutex> lock(answersMutex);
+      answers.push_back(
+          Queued{std::move(answer), deadline, std::move(handler)});
+      if (flushing) {
+        return;
+      }
+      flushing = true;
+    }
+    Post([impl = this]() { impl->flush(); });
+  }
+
+private:
+  // Posts json body, compressed if enabled
+  httplib::Result post(const std::string &path, std::string body,
+                       Deadline deadline) {
+    const auto raw = body.size();
+    httplib::Headers headers;
+    if (compression == model::Compression::all) {
+      if (auto compressed = deflated(body)) {
+        body = std::move(compressed.value());
+        headers.emplace("content-encoding", "deflate");
+      }
+    }
+    auto res = send(path, false, deadline,
+                    [&path, &headers, &body](httplib::Client &client) {
+                      return client.Post(path.c_str(), headers, body,
+                                         "application/json");
+                    });
+    account(path, body.size(), raw, res);
+    return res;
+  }
+
+  std::variant<model::Err, std::vector<model::AnswerStatus>>
+  sendAnswers(const std::vector<Queued> &batch, Deadline deadline) {
+    if (auto err = exceeded(deadline)) {
+      return err.value();
+    }
+    try {
+      std::string path =
+          fmt::format("/api/v1/send_answers?auth_token={}", token);
+      auto request = nlohmann::json::array();
+      for (const auto &queued : batch) {
+        request.push_back(queued.answer);
+      }
+      auto body = request.dump();
+      spdlog::debug("Sending {} answers: {}", batch.size(), body);
+      auto res = post(path, std::move(body), deadline);
+      return processResponse<std::vector<model::AnswerStatus>, 2>(res,
+                                                                  {200, 202});
+    } catch (...) {
+      return exceptionToErr();
+    }
+  }
+
+  // Sends answers one by one, every one on a connection of its own
+  void pipeline(std::vector<Queued> batch) {
+    for (auto &queued : batch) {
+      Post([impl = this, queued = std::move(queued)]() {
+        queued.handler(impl->SendAnswer(queued.answer, queued.deadline));
+      });
+    }
+  }
+
+  // Fails answers which are past their deadline and drops them from batch,
+  // so they don't fail the fresh ones
+  static void dropExpired(std::vector<Queued> &batch) {
+    auto expired = std::stable_partition(
+        batch.begin(), batch.end(),
+        [](const Queued &queued) { return !exceeded(queued.deadline); });
+    for (auto it = expired; it != batch.end(); ++it) {
+      it->handler(exceeded(it->deadline).value());
+    }
+    batch.erase(expired, batch.end());
+  }
+
+  void sendBatch(std::vector<Queued> batch) {
+    // batch is given time of its freshest answer: the server still takes the
+    // ones expiring meanwhile or reports them, and the rest are not cut short
+    auto deadline = std::max_element(batch.begin(), batch.end(),
+                                     [](const Queued &lhs, const Queued &rhs) {
+                                       return lhs.deadline < rhs.deadline;
+                                     })
+                        ->deadline;
+    auto resp = sendAnswers(batch, deadline);
+
+    if (auto *err = std::get_if<model::Err>(&resp)) {
+      if (err->code == 404 || err->code == 405 || err->code == 501) {
+        spdlog::info("Server doesn't take batched answers, sending them one "
+                     "by one");
+        {
+          std::lock_guard<std::mutex> lock(answersMutex);
+          batching = Batching::unsupported;
+        }
+        pipeline(std::move(batch));
+        return;
+      }
+      if (err->code == 400) {
+        // one invalid answer gets the whole batch rejected, sent alone every
+        // answer gets a status of its own
+        spdlog::warn("Server rejected a batch of {} answers, sending them one "
+                     "by one",
+                     batch.size());
+        pipeline(std::move(batch));
+        return;
+      }
+      for (auto &queued : batch) {
+        queued.handler(*err);
+      }
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(answersMutex);
+      batching = Batching::supported;
+    }
+    auto &statuses = std::get<std::vector<model::AnswerStatus>>(resp);
+    if (statuses.size() != batch.size()) {
+      model::Err err{std::nullopt, -1,
+                     fmt::format("server returned {} statuses for {} answers",
+                                 statuses.size(), batch.size())};
+      for (auto &queued : batch) {
+        queued.handler(err);
+      }
+      return;
+    }
+    for (std::size_t i = 0; i < batch.size(); i++) {
+      batch[i].handler(statuses[i]);
+    }
+  }
+
+  // Sends queued answers until there are none left
+  void flush() {
+    while (true) {
+      std::vector<Queued> batch;
+      Batching support;
+      {
+        std::lock_guard<std::mutex> lock(answersMutex);
+        batch.swap(answers);
+        if (batch.empty()) {
+          flushing = false;
+          return;
+        }
+        support = batching;
+      }
+
+      dropExpired(batch);
+      if (batch.empty()) {
+        continue;
+      }
+      if (batch.size() == 1) {
+        // answers queued meanwhile are coalesced on the next iteration
+        auto &queued = batch.front();
+        queued.handler(SendAnswer(queued.answer, queued.deadline));
+      } else if (support == Batching::unsupported) {
+        pipeline(std::move(batch));
+      } else {
+        sendBatch(std::move(batch));
+      }
+    }
+  }
 };
 
-HTTPClient::HTTPClient(std::string_view url, std::string_view token)
-    : pImpl(std::make_unique<HTTPClientImpl>(url, token)) {}
+HTTPClient::HTTPClient(std::string_view url, std::string_view token,
+                       std::size_t poolSize, model::Compression compression,
+                       const boost::filesystem::path &sessionDir)
+    : pImpl(std::make_unique<HTTPClientImpl>(url, token, poolSize, compression,
+                                             sessionDir)) {}
 
 HTTPClient::~HTTPClient() = default;
 
-std::optional<model::UserInfo> HTTPClient::doRegister() {
+HTTPClient::Timing HTTPClient::LastTiming() const {
+  return pImpl->LastTiming();
+}
+
+HTTPClient::Traffic HTTPClient::Transferred() const {
+  return pImpl->Transferred();
+}
+
+model::RegisterResponse HTTPClient::doRegister(Deadline deadline) {
   spdlog::debug("Registering");
-  auto resp = pImpl->Register();
-
-  std::optional<model::UserInfo> res = std::nullopt;
-  std::visit(model::util::overload{
-                 [](const model::Err &err) {
-                   spdlog::critical("Can`t register: {}", err);
-                 },
-                 [&res](const model::UserInfo &info) { res = info; }},
-             resp);
-  return res;
+  return pImpl->Register(deadline);
 }
 
-std::optional<model::Task> HTTPClient::doGetTask() {
+model::TaskResponse HTTPClient::doGetTask(Deadline deadline) {
   spdlog::debug("Getting task");
-  auto resp = pImpl->GetTask();
-
-  std::optional<model::Task> res = std::nullopt;
-  std::visit(
-      model::util::overload{[](const model::Err &err) {
-                              spdlog::critical("Can`t get task: {}", err);
-                            },
-                            [&res](const model::Task &info) { res = info; }},
-      resp);
-  return res;
+  return pImpl->GetTask(deadline);
 }
 
-std::optional<model::AnswerStatus>
-HTTPClient::doSendAnswer(const model::Answer &answer) {
+model::SendAnswerResponse HTTPClient::doSendAnswer(const model::Answer &answer,
+                                                   Deadline deadline) {
   spdlog::debug("Sending answer: {}", answer);
-  auto resp = pImpl->SendAnswer(answer);
-
-  std::optional<model::AnswerStatus> res = std::nullopt;
-  std::visit(model::util::overload{
-                 [](const model::Err &err) {
-                   spdlog::critical("Can`t send answer: {}", err);
-                 },
-                 [&res](const model::AnswerStatus &info) { res = info; }},
-             resp);
-  return res;
+  return pImpl->SendAnswer(answer, deadline);
+}
+
+void HTTPClient::doAsyncRegister(Deadline deadline,
+                                 Handler<model::UserInfo> handler) {
+  auto *impl = pImpl.get();
+  impl->Post([impl, deadline, handler = std::move(handler)]() {
+    spdlog::debug("Registering");
+    handler(impl->Register(deadline));
+  });
+}
+
+void HTTPClient::doAsyncGetTask(Deadline deadline,
+                                Handler<model::Task> handler) {
+  auto *impl = pImpl.get();
+  impl->Post([impl, deadline, handler = std::move(handler)]() {
+    spdlog::debug("Getting task");
+    handler(impl->GetTask(deadline));
+  });
+}
+
+void HTTPClient::doAsyncSendAnswer(const model::Answer &answer,
+                                   Deadline deadline,
+                                   Handler<model::AnswerStatus> handler) {
+  spdlog::debug("Queueing answer: {}", answer);
+  pImpl->AsyncSendAnswer(answer, deadline, std::move(handler));
 }
-} // namespace crypto
\ No newline at end of file
+
+model::Err HTTPClient::doSubscribe(const TaskCallback &onTask) {
+  return pImpl->Subscribe(onTask);
+}
+
+void HTTPClient::doUnsubscribe() { pImpl->Unsubscribe(); }
+} // namespace crypto
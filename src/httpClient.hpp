@@ -1,8 +1,13 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
 
+#include "boost/filesystem.hpp"
+
 #include "client.hpp"
 #include "models.hpp"
 
@@ -18,14 +23,57 @@ private:
   std::string token;
 
 public:
-  explicit HTTPClient(std::string_view, std::string_view);
+  // Connection setup cost of a request, zero if a kept-alive connection was
+  // used as is
+  struct Timing {
+    std::chrono::microseconds connect{0};
+    std::chrono::microseconds handshake{0};
+    // kept-alive connection was used
+    bool reused = true;
+    // TLS session of a previous connection was resumed
+    bool resumed = false;
+  };
+
+  // Body bytes exchanged with the server, wire ones are compressed
+  struct Traffic {
+    std::uint64_t sent = 0;
+    std::uint64_t sentRaw = 0;
+    std::uint64_t received = 0;
+    std::uint64_t receivedRaw = 0;
+    // compressed responses without content length, their wire size is not
+    // known, so they are left out of received sizes
+    std::uint64_t unsized = 0;
+  };
+
+  // poolSize is the max number of kept-alive connections to the server, TLS
+  // sessions are saved to sessionDir to be resumed after restart, unless it
+  // is empty
+  HTTPClient(std::string_view url, std::string_view token,
+             std::size_t poolSize,
+             model::Compression compression = model::Compression::responses,
+             const boost::filesystem::path &sessionDir = {});
   ~HTTPClient() final;
 
+  // Timing of the most recently finished request
+  Timing LastTiming() const;
+  // Traffic of all requests since start, task channel excluded
+  Traffic Transferred() const;
+
 private:
-  std::optional<model::UserInfo> doRegister() final;
-  std::optional<model::Task> doGetTask() final;
-  std::optional<model::AnswerStatus>
-  doSendAnswer(const model::Answer &answer) final;
+  model::RegisterResponse doRegister(Deadline deadline) final;
+  model::TaskResponse doGetTask(Deadline deadline) final;
+  model::SendAnswerResponse doSendAnswer(const model::Answer &answer,
+                                         Deadline deadline) final;
+
+  void doAsyncRegister(Deadline deadline,
+                       Handler<model::UserInfo> handler) final;
+  void doAsyncGetTask(Deadline deadline, Handler<model::Task> handler) final;
+  void doAsyncSendAnswer(const model::Answer &answer, Deadline deadline,
+                         Handler<model::AnswerStatus> handler) final;
+
+  // Task channel is GET /api/v1/task/subscribe streaming server-sent events
+  model::Err doSubscribe(const TaskCallback &onTask) final;
+  void doUnsubscribe() final;
 };
 } // namespace crypto
 
@@ -0,0 +1,280 @@
+#include "journal.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "boost/asio/error.hpp"
+#include "boost/system/error_code.hpp"
+#include "cppcodec/base64_rfc4648.hpp"
+#include "fmt/core.h"
+#include "nlohmann/json.hpp"
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+namespace {
+using codec = cppcodec::base64_rfc4648;
+
+const char *const FOUND = "found";
+const char *const ACK = "ack";
+
+nlohmann::json foundRecord(const std::string &key, const model::Answer &a) {
+  nlohmann::json j;
+  j["op"] = FOUND;
+  j["key"] = key;
+  j["giver_address"] = a.giver_address;
+  j["seed"] = a.seed;
+  j["expires"] = a.expires.GetUnix();
+  j["boc_data"] = codec::encode(a.boc);
+  return j;
+}
+
+AnswerJournal::Entry fromFoundRecord(const nlohmann::json &j) {
+  AnswerJournal::Entry entry;
+  j.at("key").get_to(entry.key);
+  j.at("giver_address").get_to(entry.answer.giver_address);
+  j.at("seed").get_to(entry.answer.seed);
+  entry.answer.expires = model::util::Timestamp(j.at("expires").get<long>());
+  entry.answer.boc = codec::decode(j.at("boc_data").get<std::string>());
+  return entry;
+}
+
+// Makes rename in the directory durable
+void syncDirectory(const boost::filesystem::path &file) {
+  auto dir = file.parent_path();
+  if (dir.empty()) {
+    dir = ".";
+  }
+  int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "journal directory open");
+  }
+  auto rc = ::fsync(dirFd);
+  auto err = errno;
+  ::close(dirFd);
+  if (rc != 0) {
+    throw std::system_error(err, std::generic_category(),
+                            "journal directory fsync");
+  }
+}
+
+void writeAll(int fd, const std::string &data) {
+  std::size_t written = 0;
+  while (written < data.size()) {
+    auto n = ::write(fd, data.data() + written, data.size() - written);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error(errno, std::generic_category(), "journal write");
+    }
+    written += static_cast<std::size_t>(n);
+  }
+}
+} // namespace
+
+AnswerJournal::AnswerJournal(Reactor &reactor, boost::filesystem::path _path)
+    : path(std::move(_path)), flusher(reactor.Get()) {
+  open();
+}
+
+AnswerJournal::~AnswerJournal() {
+  std::lock_guard<std::mutex> lock(mutex);
+  flusher.cancel();
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+}
+
+void AnswerJournal::open() {
+  fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            fmt::format("can`t open journal {}", path));
+  }
+}
+
+void AnswerJournal::flush() {
+  std::lock_guard<std::mutex> lock(mutex);
+  dirty = false;
+  if (::fsync(fd) != 0) {
+    spdlog::error("Journal fsync failed: {}", std::strerror(errno));
+  }
+
+  if (!bloated()) {
+    return;
+  }
+  std::vector<Entry> entries;
+  auto now = std::time(nullptr);
+  for (auto it = live.begin(); it != live.end();) {
+    // expired answer is dropped on replay anyway
+    if (it->second.expires.GetUnix() <= now) {
+      it = live.erase(it);
+      continue;
+    }
+    entries.push_back(Entry{it->first, it->second});
+    ++it;
+  }
+  try {
+    auto before = records;
+    compact(entries);
+    spdlog::debug("Journal compacted from {} to {} records", before, records);
+  } catch (std::exception &e) {
+    spdlog::error("Can`t compact journal: {}", e.what());
+  }
+}
+
+bool AnswerJournal::bloated() const {
+  // every acked answer leaves two records, live one leaves a single record
+  return records >= compactAfter && records > 2 * live.size();
+}
+
+void AnswerJournal::append(const std::string &line, bool sync) {
+  writeAll(fd, line + "\n");
+  records++;
+  // acks are not synced, but they may make the journal worth compacting
+  if ((sync || bloated()) && !dirty) {
+    dirty = true;
+    flusher.expires_after(batchWindow);
+    flusher.async_wait([this](const boost::system::error_code &ec) {
+      if (ec == boost::asio::error::operation_aborted) {
+        return;
+      }
+      flush();
+    });
+  }
+}
+
+std::string AnswerJournal::Key(const model::Answer &answer) {
+  std::string boc(answer.boc.begin(), answer.boc.end());
+  return fmt::format("{}/{}/{:016x}", answer.giver_address, answer.seed,
+                     std::hash<std::string>{}(boc));
+}
+
+std::string AnswerJournal::Record(const model::Answer &answer) {
+  auto key = Key(answer);
+  try {
+    std::lock_guard<std::mutex> lock(mutex);
+    append(foundRecord(key, answer).dump(), true);
+    live[key] = answer;
+  } catch (std::exception &e) {
+    spdlog::error("Can`t journal answer {}: {}", key, e.what());
+  }
+  return key;
+}
+
+void AnswerJournal::Ack(const std::string &key) {
+  nlohmann::json j;
+  j["op"] = ACK;
+  j["key"] = key;
+  try {
+    // loosing ack only makes answer to be resent, so it is not synced
+    std::lock_guard<std::mutex> lock(mutex);
+    append(j.dump(), false);
+    live.erase(key);
+  } catch (std::exception &e) {
+    spdlog::error("Can`t journal ack {}: {}", key, e.what());
+  }
+}
+
+std::vector<AnswerJournal::Entry> AnswerJournal::Recover() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // std::map keeps recovered answers in the stable order
+  std::map<std::string, Entry> pending;
+  {
+    std::ifstream in(path.c_str());
+    std::string line;
+    long lineNumber = 0;
+    while (std::getline(in, line)) {
+      lineNumber++;
+      try {
+        auto j = nlohmann::json::parse(line);
+        auto op = j.at("op").get<std::string>();
+        if (op == FOUND) {
+          auto entry = fromFoundRecord(j);
+          pending[entry.key] = std::move(entry);
+        } else if (op == ACK) {
+          pending.erase(j.at("key").get<std::string>());
+        }
+      } catch (std::exception &e) {
+        // torn last line is expected after crash
+        spdlog::warn("Skipping journal line {}: {}", lineNumber, e.what());
+      }
+    }
+  }
+
+  std::vector<Entry> res;
+  auto now = std::time(nullptr);
+  for (auto &[key, entry] : pending) {
+    if (entry.answer.expires.GetUnix() <= now) {
+      spdlog::info("Journaled answer {} expired, dropping", key);
+      continue;
+    }
+    res.push_back(std::move(entry));
+  }
+
+  live.clear();
+  for (const auto &entry : res) {
+    live[entry.key] = entry.answer;
+  }
+  try {
+    compact(res);
+  } catch (std::exception &e) {
+    spdlog::error("Can`t compact journal: {}", e.what());
+  }
+  spdlog::info("Recovered {} unsent answers from journal", res.size());
+  return res;
+}
+
+void AnswerJournal::compact(const std::vector<Entry> &entries) {
+  // write entries to the new file and replace the old one with it, the new
+  // file is opened for appending, so it is appended to after the rename
+  auto tmp = path;
+  tmp += ".tmp";
+  int tmpFd = ::open(tmp.c_str(),
+                     O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+  if (tmpFd < 0) {
+    throw std::system_error(errno, std::generic_category(),
+                            "journal compaction");
+  }
+  try {
+    for (const auto &entry : entries) {
+      writeAll(tmpFd, foundRecord(entry.key, entry.answer).dump() + "\n");
+    }
+    if (::fsync(tmpFd) != 0) {
+      throw std::system_error(errno, std::generic_category(),
+                              "journal compaction fsync");
+    }
+    boost::filesystem::rename(tmp, path);
+  } catch (...) {
+    ::close(tmpFd);
+    throw;
+  }
+
+  // journal is never left without a descriptor: the old one is replaced
+  // only by the already open new one
+  ::close(fd);
+  fd = tmpFd;
+  records = entries.size();
+  // rename is lost on crash until the directory is synced, the old journal is
+  // still whole then
+  syncDirectory(path);
+}
+
+} // namespace crypto
@@ -0,0 +1,88 @@
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "boost/asio/steady_timer.hpp"
+#include "boost/filesystem.hpp"
+
+#include "models.hpp"
+#include "reactor.hpp"
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+namespace crypto {
+
+// AnswerJournal is an append-only on disk log of found answers. Answer is
+// recorded as soon as it is found and marked when server acknowledged it, so
+// answers not sent because of crash or restart could be replayed on start.
+//
+// Every line is a json record: {"op":"found", "key":..., answer fields} or
+// {"op":"ack", "key":...}. Key is built from giver, seed and boc hash.
+// Journal is compacted on start and, once acknowledged records dominate, on
+// the flush timer, so it doesn't grow on a long-running rig.
+class AnswerJournal {
+public:
+  struct Entry {
+    std::string key;
+    model::Answer answer;
+  };
+
+private:
+  // found records are synced in batches: the first one arms the timer, which
+  // waits a bit more for others and then calls fsync once
+  static constexpr auto batchWindow = std::chrono::milliseconds(50);
+  // smaller journal is not compacted, whatever the share of acked records
+  static constexpr std::size_t compactAfter = 256;
+
+  const boost::filesystem::path path;
+  int fd = -1;
+
+  std::mutex mutex;
+  bool dirty = false;
+  boost::asio::steady_timer flusher;
+  // unacknowledged answers by key, they are what compaction keeps
+  std::map<std::string, model::Answer> live;
+  // records in the journal file
+  std::size_t records = 0;
+
+public:
+  AnswerJournal(Reactor &reactor, boost::filesystem::path _path);
+  ~AnswerJournal();
+
+  AnswerJournal(AnswerJournal &) = delete;
+  AnswerJournal(AnswerJournal &&) = delete;
+
+  AnswerJournal &operator=(AnswerJournal &) = delete;
+  AnswerJournal &operator=(AnswerJournal &&) = delete;
+
+private:
+  // NOTE: must be called with locked mutex
+  void append(const std::string &line, bool sync);
+  void flush();
+  void open();
+  // Returns true if acknowledged records dominate the journal
+  // NOTE: must be called with locked mutex
+  bool bloated() const;
+  // Replaces journal with found records of entries. Throws on failure, the
+  // old journal is kept then.
+  // NOTE: must be called with locked mutex
+  void compact(const std::vector<Entry> &entries);
+
+public:
+  static std::string Key(const model::Answer &answer);
+
+  // Returns key of the recorded answer
+  std::string Record(const model::Answer &answer);
+  void Ack(const std::string &key);
+  // Reads journal, drops acknowledged and expired entries, rewrites it with
+  // the rest and returns them
+  std::vector<Entry> Recover();
+};
+
+} // namespace crypto
+
+#endif
@@ -1,5 +1,11 @@
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
 #include <string_view>
+#include <variant>
+#include <vector>
 
 #include "boost/core/ignore_unused.hpp"
 
@@ -16,7 +22,7 @@ auto inline defaultUserInfo() {
 
 auto inline defaultTask() {
   model::Task res;
-  res.expires = model::util::Timestamp(std::chrono::steady_clock::now() +
+  res.expires = model::util::Timestamp(std::chrono::system_clock::now() +
                                        std::chrono::seconds(5));
   res.pool_address = "kQBWkNKqzCAwA9vjMwRmg7aY75Rf8lByPA9zKXoqGkHi8SM7";
   res.seed = "229760179690128740373110445116482216837";
@@ -33,6 +39,38 @@ class MockClient final : public Client {
 private:
   std::string url;
 
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool unsubscribed = false;
+  // scripted errors, requests take them before answering with defaults
+  std::deque<model::Err> failures;
+  int requests = 0;
+  // asynchronous requests are not answered until Release while held
+  bool holding = false;
+  std::vector<std::function<void()>> held;
+
+  void deliver(std::function<void()> reply) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (holding) {
+        held.push_back(std::move(reply));
+        return;
+      }
+    }
+    reply();
+  }
+
+  template <class T> std::variant<model::Err, T> respond(T value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    requests++;
+    if (failures.empty()) {
+      return value;
+    }
+    auto err = failures.front();
+    failures.pop_front();
+    return err;
+  }
+
 public:
   explicit MockClient(std::string_view url,
                       std::string_view token){
@@ -41,15 +79,79 @@ public:
                       };
   ~MockClient() final = default;
 
+  // Makes the next requests fail with err, one per request
+  void Fail(const model::Err &err, int times = 1) {
+    std::lock_guard<std::mutex> lock(mutex);
+    failures.insert(failures.end(), times, err);
+  }
+  // Makes asynchronous requests wait for Release
+  void Hold() {
+    std::lock_guard<std::mutex> lock(mutex);
+    holding = true;
+  }
+  // Answers held requests, further ones are answered at once
+  void Release() {
+    std::vector<std::function<void()>> replies;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      holding = false;
+      replies.swap(held);
+    }
+    for (auto &reply : replies) {
+      reply();
+    }
+  }
+  // Returns number of requests made, channel is not counted
+  int Requests() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return requests;
+  }
+
 private:
-  std::optional<model::UserInfo> doRegister() final {
-    return defaultUserInfo();
+  model::RegisterResponse doRegister(Deadline deadline) final {
+    boost::ignore_unused(deadline);
+    return respond(defaultUserInfo());
+  };
+  model::TaskResponse doGetTask(Deadline deadline) final {
+    boost::ignore_unused(deadline);
+    return respond(defaultTask());
   };
-  std::optional<model::Task> doGetTask() final { return defaultTask(); };
-  std::optional<model::AnswerStatus>
-  doSendAnswer(const model::Answer &answer) final {
+  model::SendAnswerResponse doSendAnswer(const model::Answer &answer,
+                                         Deadline deadline) final {
     boost::ignore_unused(answer);
-    return defaultAnswerStatus();
+    boost::ignore_unused(deadline);
+    return respond(defaultAnswerStatus());
+  };
+
+  // mock answers at once unless held, so handlers are called on the calling
+  // thread
+  void doAsyncRegister(Deadline deadline,
+                       Handler<model::UserInfo> handler) final {
+    deliver([this, deadline, handler]() { handler(doRegister(deadline)); });
+  };
+  void doAsyncGetTask(Deadline deadline, Handler<model::Task> handler) final {
+    deliver([this, deadline, handler]() { handler(doGetTask(deadline)); });
+  };
+  void doAsyncSendAnswer(const model::Answer &answer, Deadline deadline,
+                         Handler<model::AnswerStatus> handler) final {
+    deliver([this, answer, deadline, handler]() {
+      handler(doSendAnswer(answer, deadline));
+    });
+  };
+
+  // pushes the default task once and keeps the channel open
+  model::Err doSubscribe(const TaskCallback &onTask) final {
+    onTask(defaultTask());
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this]() { return unsubscribed; });
+    return model::Err{std::nullopt, 0, "unsubscribed"};
+  };
+  void doUnsubscribe() final {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      unsubscribed = true;
+    }
+    cond.notify_all();
   };
 };
 
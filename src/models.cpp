@@ -4,12 +4,19 @@
 #include <chrono>
 #include <cstddef>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <numeric>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
+#include "boost/algorithm/string.hpp"
 #include "boost/core/ignore_unused.hpp"
+#include "boost/lexical_cast.hpp"
+#include "boost/range/algorithm.hpp"
 #include "cppcodec/base64_rfc4648.hpp"
 #include "fmt/core.h"
 #include "fmt/format.h"
@@ -17,6 +24,83 @@
 
 namespace crypto::model {
 
+std::string ParseGPU(std::vector<int> &result_gpus, std::string_view gpuRange) {
+  // Yes, this stupid boilerplate code is needed just to parse
+  // two numbers and a dash in square brackets (like [1-4]).
+  // Yes, it`s dumb, as soon, as we could make one simple regex.
+  // But, first of all, regex is always a technical debt, learn to live without
+  // them. Secondly, I want to make user friendly cli with user friendly error
+  // messages. There are always a donkey: user or developer.
+  std::vector<int> gpus;
+  if (gpuRange.empty()) {
+    return "empty range";
+  }
+  if (gpuRange[0] != '[') {
+    return "invalid format: not [ on first place";
+  }
+  if (gpuRange.back() != ']') {
+    return "invalid format: not ] on the last place";
+  }
+
+  // Remove brackets, now we are working with range_str, not gpuRange
+  auto range_str = gpuRange.substr(1, gpuRange.size() - 2);
+
+  // split ranges by comma
+  std::vector<std::string> ranges;
+  boost::split(ranges, range_str, boost::is_any_of(","));
+
+  // now we are working on range(it is just one number or range like `1-4`)
+  for (const auto &range : ranges) {
+    bool is_number = false;
+    int gpu_number = -1;
+    try {
+      gpu_number = boost::lexical_cast<int>(range);
+      is_number = true;
+    } catch (boost::bad_lexical_cast &) {
+    }
+
+    // if it is just number then just push to back its value
+    if (is_number) {
+      gpus.emplace_back(gpu_number);
+      continue;
+    }
+
+    const auto dash = range.find('-');
+    if (dash == std::basic_string<char>::npos) {
+      return "dash is missed";
+    }
+    if (dash == 0) {
+      return "first number is missed or negative";
+    }
+
+    auto ls = range.substr(0, dash);
+    auto rs = range.substr(dash + 1);
+    int l = 0;
+    int r = 0;
+    try {
+      l = boost::lexical_cast<int>(ls);
+      r = boost::lexical_cast<int>(rs);
+    } catch (...) {
+      return fmt::format("can`t parse numbers: {} and {}", ls, rs);
+    }
+
+    if (r < l) {
+      return "right < left number";
+    }
+
+    const auto old_size = gpus.size();
+    gpus.resize(old_size + r - l + 1);
+    std::iota(std::next(gpus.begin(), (long)old_size), gpus.end(), l);
+  }
+
+  // make gpus unique
+  auto unique_gpus = boost::range::unique(gpus);
+
+  boost::range::copy(unique_gpus, std::back_inserter(result_gpus));
+
+  return "";
+}
+
 std::string Dump(const Err &e) {
   return fmt::format("Err{{code: {}, msg:{}, body: {}}}", e.code, e.msg,
                      e.body.value_or("(no body)"));
@@ -44,9 +128,11 @@ std::string Dump(const Task &task) {
 }
 
 std::string Dump(const MinerTask &task) {
-  return fmt::format("MinerTask{{gpu: [{}], iterations: {}, task: {}}}",
-                     fmt::join(task.gpu, ", "), task.iterations,
-                     Dump(static_cast<const Task &>(task)));
+  return fmt::format(
+      "MinerTask{{gpu: [{}], iterations: {}, deadline: {}, task: {}}}",
+      fmt::join(task.gpu, ", "), task.iterations,
+      util::Timestamp(task.deadline).GetUnix(),
+      Dump(static_cast<const Task &>(task)));
 }
 
 std::string Dump(const AnswerStatus &status) {
@@ -54,19 +140,110 @@ std::string Dump(const AnswerStatus &status) {
 }
 
 std::string Dump(const Answer &answer) {
-  return fmt::format("Answer{{giver: {}, boc: {}}}", answer.giver_address,
-                     fmt::join(answer.boc, ""));
+  return fmt::format("Answer{{giver: {}, seed: {}, expires: {}, boc: {}}}",
+                     answer.giver_address, answer.seed,
+                     answer.expires.GetUnix(), fmt::join(answer.boc, ""));
+}
+
+std::string ParseUrls(std::vector<std::string> &result_urls,
+                      std::string_view urls) {
+  std::vector<std::string> parts;
+  boost::split(parts, urls, boost::is_any_of(","));
+
+  std::vector<std::string> res;
+  for (auto &part : parts) {
+    boost::trim(part);
+    if (part.empty()) {
+      return "empty url";
+    }
+    if (std::find(res.begin(), res.end(), part) != res.end()) {
+      return fmt::format("url {} is given twice", part);
+    }
+    res.push_back(std::move(part));
+  }
+
+  result_urls = std::move(res);
+  return "";
+}
+
+namespace {
+const std::map<std::string_view, Compression> compressions = {
+    {"off", Compression::off},
+    {"responses", Compression::responses},
+    {"all", Compression::all},
+};
+} // namespace
+
+std::string ParseCompression(std::map<std::string, Compression> &result,
+                             std::string_view modes,
+                             const std::vector<std::string> &urls) {
+  std::vector<std::string> parts;
+  boost::split(parts, modes, boost::is_any_of(","));
+
+  std::map<std::string, Compression> res = {{"", Compression::responses}};
+  for (auto &part : parts) {
+    boost::trim(part);
+    std::string url;
+    auto mode = std::string_view(part);
+    const auto eq = mode.find('=');
+    if (eq != std::string_view::npos) {
+      url = boost::trim_copy(std::string(mode.substr(0, eq)));
+      mode = mode.substr(eq + 1);
+      if (std::find(urls.begin(), urls.end(), url) == urls.end()) {
+        return fmt::format("url {} is not among server urls", url);
+      }
+    }
+    auto it = compressions.find(boost::trim_copy(std::string(mode)));
+    if (it == compressions.end()) {
+      return fmt::format("unknown mode {}, expected off, responses or all",
+                         mode);
+    }
+    res[url] = it->second;
+  }
+
+  result = std::move(res);
+  return "";
+}
+
+std::string Dump(Compression compression) {
+  for (const auto &[name, value] : compressions) {
+    if (value == compression) {
+      return std::string(name);
+    }
+  }
+  return "unknown";
 }
 
 std::string Dump(const Config &cfg) {
   // NOTE: INCREMENT AFTER UPDATING CONFIG
-  constexpr int expected = 8;
+  constexpr int expected = 19;
   static_assert(Config::numberOfField == expected, "Printer not updated");
+  std::vector<std::string> compression;
+  for (const auto &[url, mode] : cfg.compression) {
+    compression.push_back(url.empty() ? Dump(mode)
+                                      : fmt::format("{}={}", url, Dump(mode)));
+  }
   return fmt::format(
-      "Config{{url:{}, logLevel:{}, logPath:{}, token:NOT_PRINTED, miner: "
-      "{}, boostFactor: {}, iterations: {}, gpu: [{}]}}",
-      cfg.url, cfg.logLevel, cfg.logPath, cfg.miner, cfg.boostFactor,
-      cfg.iterations, fmt::join(cfg.gpu, ", "));
+      "Config{{url:[{}], logLevel:{}, logPath:{}, token:NOT_PRINTED, miner: "
+      "{}, boostFactor: {}, iterations: {}, gpu: [{}], pollInterval: {}, "
+      "independent: {}, multiShare: {}, journalPath: {}, configPath: {}, "
+      "poolSize: {}, subscribe: {}, taskTimeout: {}, compression: [{}], "
+      "sessionDir: {}, hedgePercentile: {}}}",
+      fmt::join(cfg.url, ", "), cfg.logLevel, cfg.logPath, cfg.miner,
+      cfg.boostFactor, cfg.iterations, fmt::join(cfg.gpu, ", "),
+      cfg.pollInterval, cfg.independent, cfg.multiShare, cfg.journalPath,
+      cfg.configPath, cfg.poolSize, cfg.subscribe, cfg.taskTimeout,
+      fmt::join(compression, ", "), cfg.sessionDir, cfg.hedgePercentile);
+}
+
+std::string Dump(const Reloadable &r) {
+  auto gpu = r.gpu ? fmt::format("[{}]", fmt::join(r.gpu.value(), ", "))
+                   : std::string("(same)");
+  auto factor =
+      r.boostFactor ? std::to_string(r.boostFactor.value()) : "(same)";
+  auto miner = r.miner ? r.miner->string() : "(same)";
+  return fmt::format("Reloadable{{boostFactor: {}, gpu: {}, miner: {}}}",
+                     factor, gpu, miner);
 }
 
 void to_json(json &j, const UserInfo &info) {
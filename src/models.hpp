@@ -29,6 +29,13 @@ struct Err {
   std::optional<std::string> body;
   int code;
   std::string msg;
+
+  // request was not sent, as there was no time left before its deadline
+  static constexpr int deadlineExceeded = -2;
+  // request was not sent, as the server is considered down
+  static constexpr int circuitOpen = -3;
+  // no response at all: connection, tls, read or write failure
+  static constexpr int transport = -4;
 };
 
 struct Ok {
@@ -59,7 +66,9 @@ private:
 public:
   Timestamp() = default;
   explicit Timestamp(long unix_timestamp) : unixTime(unix_timestamp) {}
-  explicit Timestamp(time::time_point<time::steady_clock> tp) {
+  // NOTE: server timestamps are unix time, so only system_clock could be used
+  // here, steady_clock epoch is unspecified
+  explicit Timestamp(time::time_point<time::system_clock> tp) {
     unixTime =
         time::duration_cast<time::seconds>(tp.time_since_epoch()).count();
   }
@@ -72,7 +81,7 @@ public:
 
   long GetUnix() const { return unixTime; }
   auto GetChrono() const {
-    return time::time_point<time::steady_clock>{time::seconds{unixTime}};
+    return time::time_point<time::system_clock>{time::seconds{unixTime}};
   }
 };
 
@@ -103,11 +112,17 @@ struct Answer {
   std::vector<Byte> boc;
   std::string giver_address;
   std::optional<Statistic> statistic;
+  // task the answer was mined for, they are not sent to the server
+  std::string seed;
+  util::Timestamp expires;
 };
 
 struct MinerTask : Task {
   long long iterations;
   std::vector<int> gpu;
+  // miners are stopped at deadline, it is before expires to leave time for
+  // the answer submission
+  std::chrono::system_clock::time_point deadline;
 
   MinerTask &operator=(const Task &task) {
     Task::operator=(task);
@@ -115,23 +130,49 @@ struct MinerTask : Task {
   }
 
   MinerTask(long long _iterations, const Task &task, std::vector<int> _gpu)
-      : iterations(_iterations), gpu(std::move(_gpu)) {
+      : iterations(_iterations), gpu(std::move(_gpu)),
+        deadline(task.expires.GetChrono()) {
     *this = task;
   }
 };
 
+// What is compressed in exchanges with a server endpoint
+enum class Compression {
+  off,
+  // gzip or deflate responses are accepted
+  responses,
+  // answers are sent gzipped as well, server must accept such requests
+  all,
+};
+
 struct Config {
   std::string token;
-  std::string url;
+  // server endpoints, requests go to the healthiest of them
+  std::vector<std::string> url;
   spdlog::level::level_enum logLevel;
   boost::filesystem::path logPath;
   boost::filesystem::path miner;
   long boostFactor;
   long long iterations;
   std::vector<int> gpu;
+  long pollInterval;
+  bool independent;
+  bool multiShare;
+  boost::filesystem::path journalPath;
+  boost::filesystem::path configPath;
+  long poolSize;
+  bool subscribe;
+  // seconds given to register and task requests, retries included
+  long taskTimeout;
+  // compression by endpoint url, the one of empty url is for the rest
+  std::map<std::string, Compression> compression;
+  // TLS sessions are saved there to be resumed after restart, empty disables
+  boost::filesystem::path sessionDir;
+  // percentile of task fetch time a slow fetch is hedged after, 0 disables
+  long hedgePercentile;
 
   // NOTE: DONT FORGET TO INCRIMENT IN CASE OF ADDING OPTIONS
-  static constexpr int numberOfField = 8;
+  static constexpr int numberOfField = 19;
 
   template <class... Args> explicit constexpr Config(Args... args) {
     static_assert(sizeof...(args) == numberOfField,
@@ -140,6 +181,13 @@ struct Config {
   }
 };
 
+// Settings which could be changed without restart, absent ones stay as is
+struct Reloadable {
+  std::optional<long> boostFactor;
+  std::optional<std::vector<int>> gpu;
+  std::optional<boost::filesystem::path> miner;
+};
+
 class TokenOption {
   std::string data;
 
@@ -153,12 +201,12 @@ public:
 };
 
 class UrlOption {
-  std::string data;
+  std::vector<std::string> data;
 
 public:
   void Set(Config &cfg) { cfg.url = std::move(data); }
 
-  UrlOption &operator=(std::string url) {
+  UrlOption &operator=(std::vector<std::string> url) {
     data = std::move(url);
     return *this;
   }
@@ -269,6 +317,147 @@ public:
   }
 };
 
+class PollIntervalOption {
+  long data;
+
+public:
+  void Set(Config &cfg) { cfg.pollInterval = data; }
+
+  PollIntervalOption &operator=(long seconds) {
+    data = seconds;
+    return *this;
+  }
+};
+
+class IndependentOption {
+  bool data;
+
+public:
+  void Set(Config &cfg) { cfg.independent = data; }
+
+  IndependentOption &operator=(bool independent) {
+    data = independent;
+    return *this;
+  }
+};
+
+class MultiShareOption {
+  bool data;
+
+public:
+  void Set(Config &cfg) { cfg.multiShare = data; }
+
+  MultiShareOption &operator=(bool multiShare) {
+    data = multiShare;
+    return *this;
+  }
+};
+
+class JournalPathOption {
+  boost::filesystem::path journal;
+
+public:
+  void Set(Config &cfg) { cfg.journalPath = std::move(journal); }
+
+  JournalPathOption &operator=(boost::filesystem::path path) {
+    journal = std::move(path);
+    return *this;
+  }
+  JournalPathOption &operator=(std::string_view path) {
+    return *this = boost::filesystem::path(path.data());
+  }
+};
+
+class ConfigPathOption {
+  boost::filesystem::path config;
+
+public:
+  void Set(Config &cfg) { cfg.configPath = std::move(config); }
+
+  ConfigPathOption &operator=(boost::filesystem::path path) {
+    config = std::move(path);
+    return *this;
+  }
+  ConfigPathOption &operator=(std::string_view path) {
+    return *this = boost::filesystem::path(path.data());
+  }
+};
+
+class PoolSizeOption {
+  long data;
+
+public:
+  void Set(Config &cfg) { cfg.poolSize = data; }
+
+  PoolSizeOption &operator=(long size) {
+    data = size;
+    return *this;
+  }
+};
+
+class SubscribeOption {
+  bool data;
+
+public:
+  void Set(Config &cfg) { cfg.subscribe = data; }
+
+  SubscribeOption &operator=(bool subscribe) {
+    data = subscribe;
+    return *this;
+  }
+};
+
+class TaskTimeoutOption {
+  long data;
+
+public:
+  void Set(Config &cfg) { cfg.taskTimeout = data; }
+
+  TaskTimeoutOption &operator=(long seconds) {
+    data = seconds;
+    return *this;
+  }
+};
+
+class CompressionOption {
+  std::map<std::string, Compression> data;
+
+public:
+  void Set(Config &cfg) { cfg.compression = std::move(data); }
+
+  CompressionOption &operator=(std::map<std::string, Compression> byUrl) {
+    data = std::move(byUrl);
+    return *this;
+  }
+};
+
+class SessionDirOption {
+  boost::filesystem::path dir;
+
+public:
+  void Set(Config &cfg) { cfg.sessionDir = std::move(dir); }
+
+  SessionDirOption &operator=(boost::filesystem::path path) {
+    dir = std::move(path);
+    return *this;
+  }
+  SessionDirOption &operator=(std::string_view path) {
+    return *this = boost::filesystem::path(path.data());
+  }
+};
+
+class HedgePercentileOption {
+  long data;
+
+public:
+  void Set(Config &cfg) { cfg.hedgePercentile = data; }
+
+  HedgePercentileOption &operator=(long percentile) {
+    data = percentile;
+    return *this;
+  }
+};
+
 inline TokenOption Token;
 inline UrlOption Url;
 inline LogLevelOption LogLevel;
@@ -277,6 +466,33 @@ inline MinerPathOption MinerPath;
 inline BoostFactorOption BoostFactor;
 inline IterationsOption Iterations;
 inline GPUOptions GPU;
+inline PollIntervalOption PollInterval;
+inline IndependentOption Independent;
+inline MultiShareOption MultiShare;
+inline JournalPathOption JournalPath;
+inline ConfigPathOption ConfigPath;
+inline PoolSizeOption PoolSize;
+inline SubscribeOption Subscribe;
+inline TaskTimeoutOption TaskTimeout;
+inline CompressionOption Compress;
+inline SessionDirOption SessionDir;
+inline HedgePercentileOption HedgePercentile;
+
+// Parses devices range like [0-2,4], returns error description or empty
+// string on success
+std::string ParseGPU(std::vector<int> &result_gpus, std::string_view gpuRange);
+
+// Parses comma separated server urls, returns error description or empty
+// string on success
+std::string ParseUrls(std::vector<std::string> &result_urls,
+                      std::string_view urls);
+
+// Parses comma separated compression modes (off, responses, all), either
+// bare default one or url=mode for one of urls. Returns error description or
+// empty string on success, result always has the default.
+std::string ParseCompression(std::map<std::string, Compression> &result,
+                             std::string_view modes,
+                             const std::vector<std::string> &urls);
 
 std::string Dump(const Err &);
 std::string Dump(const Ok &);
@@ -285,7 +501,9 @@ std::string Dump(const Task &);
 std::string Dump(const MinerTask &);
 std::string Dump(const AnswerStatus &);
 std::string Dump(const Answer &);
+std::string Dump(Compression);
 std::string Dump(const Config &);
+std::string Dump(const Reloadable &);
 
 using json = nlohmann::json;
 
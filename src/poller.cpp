@@ -0,0 +1,100 @@
+#include "poller.hpp"
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <variant>
+
+#include "boost/asio/error.hpp"
+#include "boost/system/error_code.hpp"
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+TaskPoller::TaskPoller(Reactor &_reactor, Client &_client,
+                       std::chrono::seconds _interval, Callback _onChange)
+    : client(_client), interval(_interval),
+      onChange(std::move(_onChange)), timer(_reactor.Get()) {
+  if (interval.count() <= 0) {
+    spdlog::info("Task polling disabled");
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  schedule();
+}
+
+TaskPoller::~TaskPoller() { Stop(); }
+
+bool TaskPoller::Changed(const model::Task &lhs, const model::Task &rhs) {
+  return lhs.seed != rhs.seed || lhs.giver_address != rhs.giver_address;
+}
+
+void TaskPoller::schedule() {
+  timer.expires_after(interval);
+  timer.async_wait([this](const boost::system::error_code &ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (stopped) {
+        return;
+      }
+      if (!watched) {
+        schedule();
+        return;
+      }
+      polling = true;
+    }
+    // NOTE: not under the lock, as handler may be called right away
+    spdlog::trace("Polling task");
+    client.AsyncGetTask(
+        [this](model::TaskResponse resp) { polled(std::move(resp)); });
+  });
+}
+
+void TaskPoller::polled(model::TaskResponse resp) {
+  auto *task = std::get_if<model::Task>(&resp);
+  if (task == nullptr) {
+    spdlog::warn("Can`t poll task: {}", std::get<model::Err>(resp));
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  // callback is called under the lock, so Stop waits for it
+  if (!stopped && task != nullptr && watched &&
+      Changed(watched.value(), *task)) {
+    spdlog::info("Task changed during the round: {}", *task);
+    watched = *task;
+    onChange(*task);
+  }
+
+  polling = false;
+  if (stopped) {
+    cond.notify_all();
+    return;
+  }
+  schedule();
+}
+
+void TaskPoller::Watch(const model::Task &task) {
+  std::lock_guard<std::mutex> lock(mutex);
+  watched = task;
+}
+
+void TaskPoller::Push(const model::Task &task) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!stopped && watched && Changed(watched.value(), task)) {
+    spdlog::info("Task changed by server push: {}", task);
+    watched = task;
+    onChange(task);
+  }
+}
+
+void TaskPoller::Stop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  stopped = true;
+  timer.cancel();
+  cond.wait(lock, [this]() { return !polling; });
+}
+
+} // namespace crypto
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+
+#include "boost/asio/steady_timer.hpp"
+
+#include "client.hpp"
+#include "models.hpp"
+#include "reactor.hpp"
+
+#ifndef POLLER_HPP
+#define POLLER_HPP
+
+namespace crypto {
+
+// TaskPoller asks server for the task while miners are working and reports
+// when seed or giver of the watched task has changed, so the stale work could
+// be aborted without waiting for the task expiration.
+class TaskPoller {
+public:
+  using Callback = std::function<void(const model::Task &)>;
+
+private:
+  Client &client;
+  const std::chrono::seconds interval;
+  Callback onChange;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::optional<model::Task> watched;
+  bool stopped = false;
+  // request is in flight and refers to this
+  bool polling = false;
+  boost::asio::steady_timer timer;
+
+public:
+  // Zero interval disables polling, reactor runs the polling timer
+  TaskPoller(Reactor &_reactor, Client &_client,
+             std::chrono::seconds _interval, Callback _onChange);
+  ~TaskPoller();
+
+  TaskPoller(TaskPoller &) = delete;
+  TaskPoller(TaskPoller &&) = delete;
+
+  TaskPoller &operator=(TaskPoller &) = delete;
+  TaskPoller &operator=(TaskPoller &&) = delete;
+
+private:
+  void schedule();
+  void polled(model::TaskResponse resp);
+
+public:
+  static bool Changed(const model::Task &lhs, const model::Task &rhs);
+
+  // Sets the task which is mined now
+  void Watch(const model::Task &task);
+  // Handles task pushed by the server as if it was polled
+  void Push(const model::Task &task);
+  void Stop();
+};
+
+} // namespace crypto
+
+#endif
@@ -0,0 +1,161 @@
+#include "prefetcher.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <variant>
+
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+TaskPrefetcher::TaskPrefetcher(Client &_client, Reactor &_reactor,
+                               RoundScheduler &_scheduler)
+    : client(_client), reactor(_reactor), scheduler(_scheduler),
+      latency(static_cast<double>(initialLatency.count())) {}
+
+TaskPrefetcher::~TaskPrefetcher() {
+  // in flight request refers to this
+  if (pending.valid()) {
+    timer->cancel();
+    pending.wait();
+  }
+}
+
+bool TaskPrefetcher::usable(const model::Task &task) {
+  return scheduler.Deadline(task) > RoundScheduler::clock::now();
+}
+
+void TaskPrefetcher::Prefetch(RoundScheduler::clock::time_point roundEnd) {
+  using std::chrono::milliseconds;
+
+  if (pending.valid()) {
+    return;
+  }
+
+  auto lead = milliseconds(static_cast<long>(latency * leadFactor));
+  auto wait = std::chrono::duration_cast<milliseconds>(
+      roundEnd - RoundScheduler::clock::now() - lead);
+  spdlog::debug("Prefetching next task in {}ms",
+                std::max(wait, milliseconds(0)).count());
+
+  auto fetched = std::make_shared<std::promise<Fetched>>();
+  pending = fetched->get_future();
+  timer = std::make_shared<boost::asio::steady_timer>(reactor.Get(), wait);
+  timer->async_wait([this, fetched](const boost::system::error_code &ec) {
+    if (ec) {
+      fetched->set_value(Fetched{});
+      return;
+    }
+    auto start = clock::now();
+    client.AsyncGetTask([fetched, start](model::TaskResponse resp) {
+      Fetched res{true, std::nullopt, start, clock::now() - start};
+      std::visit(model::util::overload{
+                     [](const model::Err &err) {
+                       spdlog::error("Can`t prefetch task: {}", err);
+                     },
+                     [&res](model::Task &task) { res.task = std::move(task); }},
+                 resp);
+      fetched->set_value(std::move(res));
+    });
+  });
+}
+
+void TaskPrefetcher::Offer(model::Task task) {
+  std::lock_guard<std::mutex> lock(mutex);
+  offered = std::move(task);
+  offeredAt = clock::now();
+}
+
+void TaskPrefetcher::Solved(std::string seed) {
+  std::lock_guard<std::mutex> lock(mutex);
+  solved = std::move(seed);
+  solvedAt = clock::now();
+}
+
+model::TaskResponse TaskPrefetcher::Next() {
+  saving.reset();
+
+  std::optional<model::Task> fresh;
+  clock::time_point freshAt;
+  std::optional<std::string> seed;
+  clock::time_point seedAt;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    fresh.swap(offered);
+    freshAt = offeredAt;
+    seed.swap(solved);
+    seedAt = solvedAt;
+  }
+  if (fresh && !usable(fresh.value())) {
+    fresh.reset();
+  }
+  if (fresh && seed && fresh->seed == seed.value()) {
+    fresh.reset();
+  }
+
+  if (!pending.valid()) {
+    if (fresh) {
+      return std::move(fresh.value());
+    }
+    return client.TryGetTask();
+  }
+
+  // round ended before the prefetch was due, it is fetched right away
+  timer->cancel();
+  auto waitStart = clock::now();
+  auto fetched = pending.get();
+  auto waited = clock::now() - waitStart;
+  if (fetched.sent) {
+    auto took = std::chrono::duration_cast<std::chrono::milliseconds>(
+        fetched.took);
+    latency = alpha * static_cast<double>(took.count()) + (1 - alpha) * latency;
+  }
+
+  if (fresh && (!fetched.sent || freshAt >= fetched.started)) {
+    spdlog::debug("Using offered task, it is newer than prefetched one");
+    return std::move(fresh.value());
+  }
+
+  if (!fetched.sent) {
+    return client.TryGetTask();
+  }
+  if (!fetched.task) {
+    spdlog::warn("Prefetch failed, requesting task again");
+    return client.TryGetTask();
+  }
+  if (!usable(fetched.task.value())) {
+    spdlog::debug("No time left to mine prefetched task, requesting new one");
+    return client.TryGetTask();
+  }
+  if (seed && (fetched.started < seedAt || fetched.task->seed == seed)) {
+    spdlog::debug("Prefetched task is of the solved seed, requesting new one");
+    return client.TryGetTask();
+  }
+
+  saving = Saving{fetched.took, waited};
+  return std::move(fetched.task.value());
+}
+
+void TaskPrefetcher::Mined() {
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+
+  if (!saving) {
+    return;
+  }
+  // without prefetch miners would be idle for the whole fetch, now they are
+  // idle only while we are waiting for the rest of it
+  auto saved = saving->took - saving->waited;
+  spdlog::info("Using prefetched task, idle time saved: {}ms (fetch took {}ms, "
+               "waited {}ms)",
+               duration_cast<milliseconds>(saved).count(),
+               duration_cast<milliseconds>(saving->took).count(),
+               duration_cast<milliseconds>(saving->waited).count());
+  saving.reset();
+}
+
+} // namespace crypto
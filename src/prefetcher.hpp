@@ -0,0 +1,99 @@
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "boost/asio/steady_timer.hpp"
+
+#include "client.hpp"
+#include "models.hpp"
+#include "reactor.hpp"
+#include "scheduler.hpp"
+
+#ifndef PREFETCHER_HPP
+#define PREFETCHER_HPP
+
+namespace crypto {
+
+// TaskPrefetcher is a double buffer for tasks: next task is fetched in
+// background right before the current round ends, so a new round could be
+// started at once. Fetch is timed by the measured fetch latency: sent earlier
+// it would mostly return the task being mined.
+class TaskPrefetcher {
+private:
+  using clock = std::chrono::steady_clock;
+
+  // fetch is sent so many average fetch times before the round end
+  static constexpr double leadFactor = 2.0;
+  static constexpr std::chrono::milliseconds initialLatency{500};
+  // weight of the new sample in the average fetch time
+  static constexpr double alpha = 0.2;
+
+  struct Fetched {
+    // false if fetch was cancelled before it was sent
+    bool sent = false;
+    std::optional<model::Task> task;
+    clock::time_point started;
+    clock::duration took{};
+  };
+
+  // idle time saved by the prefetched task, reported once it is mined
+  struct Saving {
+    clock::duration took;
+    clock::duration waited;
+  };
+
+  Client &client;
+  Reactor &reactor;
+  RoundScheduler &scheduler;
+  std::future<Fetched> pending;
+  std::shared_ptr<boost::asio::steady_timer> timer;
+  double latency;
+  std::optional<Saving> saving;
+
+  std::mutex mutex;
+  std::optional<model::Task> offered;
+  clock::time_point offeredAt;
+  // server rotates seed once it is solved, so tasks fetched before are stale
+  std::optional<std::string> solved;
+  clock::time_point solvedAt;
+
+  // Returns false if there is no time left to mine the task
+  bool usable(const model::Task &task);
+
+public:
+  TaskPrefetcher(Client &_client, Reactor &_reactor,
+                 RoundScheduler &_scheduler);
+  ~TaskPrefetcher();
+
+  TaskPrefetcher(TaskPrefetcher &) = delete;
+  TaskPrefetcher(TaskPrefetcher &&) = delete;
+
+  TaskPrefetcher &operator=(TaskPrefetcher &) = delete;
+  TaskPrefetcher &operator=(TaskPrefetcher &&) = delete;
+
+public:
+  // Schedules fetching of the next task for the round ending at roundEnd,
+  // does nothing if one is already scheduled or in flight
+  void Prefetch(RoundScheduler::clock::time_point roundEnd);
+  // Stores task fetched by someone else, it is preferred over prefetched one
+  // if it is newer
+  void Offer(model::Task task);
+  // Marks seed as solved: task with it or prefetched before is not returned
+  // by the next Next, fresh one is fetched instead
+  void Solved(std::string seed);
+  // Returns prefetched task if there is still time to mine it, otherwise
+  // fetches it. Prefetch not sent yet is cancelled. Results with the error if
+  // task can't be fetched.
+  // NOTE: blocks, must not be called from the reactor or client threads
+  model::TaskResponse Next();
+  // Reports that the task returned by the last Next is mined, so idle time
+  // saved by its prefetch is logged
+  void Mined();
+};
+
+} // namespace crypto
+
+#endif
@@ -0,0 +1,77 @@
+#include "reactor.hpp"
+
+#include <csignal>
+#include <exception>
+#include <thread>
+
+#include "boost/system/error_code.hpp"
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+Reactor::Reactor(std::size_t threadsNumber)
+    : work(boost::asio::make_work_guard(ioc)), signals(ioc, SIGINT, SIGTERM),
+      hangup(ioc, SIGHUP) {
+  for (std::size_t i = 0; i < threadsNumber; i++) {
+    threads.emplace_back([this]() {
+      // handlers are expected to catch their exceptions, but one escaped
+      // handler must not kill the whole loop
+      while (true) {
+        try {
+          ioc.run();
+          return;
+        } catch (std::exception &e) {
+          spdlog::error("Reactor handler thrown: {}", e.what());
+        } catch (...) {
+          spdlog::error("Reactor handler thrown unknown exception");
+        }
+      }
+    });
+  }
+  spdlog::debug("Reactor started with {} threads", threadsNumber);
+}
+
+Reactor::~Reactor() { Stop(); }
+
+void Reactor::OnSignal(std::function<void(int)> handler) {
+  signals.async_wait(
+      [handler = std::move(handler)](const boost::system::error_code &ec,
+                                     int signal) {
+        if (ec) {
+          return;
+        }
+        handler(signal);
+      });
+}
+
+void Reactor::OnHangup(std::function<void()> handler) {
+  hangup.async_wait(
+      [this, handler = std::move(handler)](const boost::system::error_code &ec,
+                                           int) {
+        if (ec) {
+          return;
+        }
+        handler();
+        OnHangup(handler);
+      });
+}
+
+void Reactor::Stop() {
+  if (threads.empty()) {
+    return;
+  }
+  boost::system::error_code ignored;
+  signals.cancel(ignored);
+  hangup.cancel(ignored);
+  work.reset();
+  ioc.stop();
+  for (auto &thread : threads) {
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+  threads.clear();
+  spdlog::debug("Reactor stopped");
+}
+
+} // namespace crypto
@@ -0,0 +1,52 @@
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "boost/asio/executor_work_guard.hpp"
+#include "boost/asio/io_context.hpp"
+#include "boost/asio/signal_set.hpp"
+
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+namespace crypto {
+
+// Reactor is the single event loop of the client: miner processes pipes and
+// exits, expiration and polling timers, retry backoffs and signals are all
+// handled by its few threads. Blocking server requests are not run here, but
+// by the workers of the HTTP client.
+class Reactor {
+private:
+  using Context = boost::asio::io_context;
+
+  Context ioc;
+  boost::asio::executor_work_guard<Context::executor_type> work;
+  boost::asio::signal_set signals;
+  boost::asio::signal_set hangup;
+  std::vector<std::thread> threads;
+
+public:
+  explicit Reactor(std::size_t threadsNumber);
+  ~Reactor();
+
+  Reactor(Reactor &) = delete;
+  Reactor(Reactor &&) = delete;
+
+  Reactor &operator=(Reactor &) = delete;
+  Reactor &operator=(Reactor &&) = delete;
+
+public:
+  Context &Get() { return ioc; }
+
+  // Calls handler on SIGINT or SIGTERM
+  void OnSignal(std::function<void(int)> handler);
+  // Calls handler on every SIGHUP
+  void OnHangup(std::function<void()> handler);
+  // Stops event loop and joins its threads, pending handlers are dropped
+  void Stop();
+};
+
+} // namespace crypto
+
+#endif
@@ -0,0 +1,221 @@
+#include "retryClient.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+bool Retryable(const model::Err &err) {
+  switch (err.code) {
+  case model::Err::transport:
+  case 408: // request timeout
+  case 425: // too early
+  case 429: // too many requests
+  case 500:
+  case 502:
+  case 503:
+  case 504:
+    return true;
+  default:
+    return false;
+  }
+}
+
+RetryClient::RetryClient(std::unique_ptr<Client> _client,
+                         boost::asio::io_context &_ioc, RetryPolicy _policy)
+    : client(std::move(_client)), ioc(_ioc), policy(_policy),
+      tokens(_policy.maxTokens), random(std::random_device{}()) {}
+
+void RetryClient::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    for (auto &timer : timers) {
+      timer->cancel();
+    }
+  }
+  cond.notify_all();
+}
+
+std::optional<RetryPolicy::duration>
+RetryClient::onFailure(Backoff &backoff, int attempt, const model::Err &err,
+                       Deadline deadline) {
+  if (!Retryable(err)) {
+    // request wasn't sent or the server refused it for good, neither says
+    // anything about its health, so the budget isn't charged
+    return std::nullopt;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  tokens = std::max(tokens - 1, 0.0);
+  backoff.failures++;
+
+  if (stopped || attempt >= policy.maxAttempts) {
+    return std::nullopt;
+  }
+  if (tokens <= policy.maxTokens / 2) {
+    spdlog::warn("Retry budget is exhausted, not retrying");
+    return std::nullopt;
+  }
+
+  // full jitter: uniform delay up to the exponential bound, so clients
+  // failed at once don't retry at once
+  auto exponent = std::min(backoff.failures - 1, 16);
+  auto bound = std::min(policy.baseDelay * (1 << exponent), policy.maxDelay);
+  std::uniform_int_distribution<RetryPolicy::duration::rep> jitter(
+      0, bound.count());
+  auto delay = RetryPolicy::duration(jitter(random));
+  if (std::chrono::system_clock::now() + delay >= deadline) {
+    spdlog::warn("No time left before the deadline, not retrying");
+    return std::nullopt;
+  }
+  return delay;
+}
+
+void RetryClient::onSuccess(Backoff &backoff) {
+  std::lock_guard<std::mutex> lock(mutex);
+  tokens = std::min(tokens + policy.tokenRatio, policy.maxTokens);
+  backoff.failures = 0;
+}
+
+bool RetryClient::sleep(RetryPolicy::duration delay) {
+  std::unique_lock<std::mutex> lock(mutex);
+  return !cond.wait_for(lock, delay, [this]() { return stopped; });
+}
+
+template <class T, class F>
+std::variant<model::Err, T>
+RetryClient::retry(std::string_view endpoint, Backoff &backoff,
+                   Deadline deadline, F &&call) {
+  for (int attempt = 1;; attempt++) {
+    std::variant<model::Err, T> resp = call();
+    auto *err = std::get_if<model::Err>(&resp);
+    if (err == nullptr) {
+      onSuccess(backoff);
+      return resp;
+    }
+
+    auto delay = onFailure(backoff, attempt, *err, deadline);
+    if (!delay) {
+      return resp;
+    }
+    spdlog::warn("Can`t {}: {}, retry #{} in {}ms", endpoint, *err, attempt,
+                 delay->count());
+    if (!sleep(delay.value())) {
+      return resp;
+    }
+  }
+}
+
+template <class T>
+void RetryClient::asyncRetry(std::string_view endpoint, Backoff &backoff,
+                             Deadline deadline,
+                             std::function<void(Handler<T>)> call,
+                             Handler<T> handler, int attempt) {
+  call([this, endpoint, &backoff, deadline, call, handler,
+        attempt](std::variant<model::Err, T> resp) {
+    auto *err = std::get_if<model::Err>(&resp);
+    if (err == nullptr) {
+      onSuccess(backoff);
+      handler(std::move(resp));
+      return;
+    }
+
+    auto delay = onFailure(backoff, attempt, *err, deadline);
+    if (!delay) {
+      handler(std::move(resp));
+      return;
+    }
+    spdlog::warn("Can`t {}: {}, retry #{} in {}ms", endpoint, *err, attempt,
+                 delay->count());
+
+    auto timer = std::make_shared<boost::asio::steady_timer>(ioc, *delay);
+    bool cancelled = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      cancelled = stopped;
+      if (!cancelled) {
+        timers.insert(timer);
+      }
+    }
+    if (cancelled) {
+      handler(std::move(resp));
+      return;
+    }
+    timer->async_wait([this, endpoint, &backoff, deadline, call, handler,
+                       attempt, timer,
+                       resp](const boost::system::error_code &ec) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        timers.erase(timer);
+      }
+      if (ec) {
+        handler(resp);
+        return;
+      }
+      asyncRetry<T>(endpoint, backoff, deadline, call, handler, attempt + 1);
+    });
+  });
+}
+
+model::RegisterResponse RetryClient::doRegister(Deadline deadline) {
+  return retry<model::UserInfo>(
+      "register", registerBackoff, deadline,
+      [this, deadline]() { return client->TryRegister(deadline); });
+}
+
+model::TaskResponse RetryClient::doGetTask(Deadline deadline) {
+  return retry<model::Task>(
+      "get task", taskBackoff, deadline,
+      [this, deadline]() { return client->TryGetTask(deadline); });
+}
+
+model::SendAnswerResponse
+RetryClient::doSendAnswer(const model::Answer &answer, Deadline deadline) {
+  return retry<model::AnswerStatus>(
+      "send answer", answerBackoff, deadline, [this, &answer, deadline]() {
+        return client->TrySendAnswer(answer, deadline);
+      });
+}
+
+void RetryClient::doAsyncRegister(Deadline deadline,
+                                  Handler<model::UserInfo> handler) {
+  asyncRetry<model::UserInfo>(
+      "register", registerBackoff, deadline,
+      [this, deadline](Handler<model::UserInfo> h) {
+        client->AsyncRegister(h, deadline);
+      },
+      std::move(handler), 1);
+}
+
+void RetryClient::doAsyncGetTask(Deadline deadline,
+                                 Handler<model::Task> handler) {
+  asyncRetry<model::Task>(
+      "get task", taskBackoff, deadline,
+      [this, deadline](Handler<model::Task> h) {
+        client->AsyncGetTask(h, deadline);
+      },
+      std::move(handler), 1);
+}
+
+void RetryClient::doAsyncSendAnswer(const model::Answer &answer,
+                                    Deadline deadline,
+                                    Handler<model::AnswerStatus> handler) {
+  // answer is resent after return, so it is copied
+  asyncRetry<model::AnswerStatus>(
+      "send answer", answerBackoff, deadline,
+      [this, answer, deadline](Handler<model::AnswerStatus> h) {
+        client->AsyncSendAnswer(answer, h, deadline);
+      },
+      std::move(handler), 1);
+}
+
+model::Err RetryClient::doSubscribe(const TaskCallback &onTask) {
+  return client->Subscribe(onTask);
+}
+
+void RetryClient::doUnsubscribe() { client->Unsubscribe(); }
+
+} // namespace crypto
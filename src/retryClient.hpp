@@ -0,0 +1,115 @@
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string_view>
+
+#include "boost/asio/io_context.hpp"
+#include "boost/asio/steady_timer.hpp"
+
+#include "client.hpp"
+#include "models.hpp"
+
+#ifndef RETRY_CLIENT_HPP
+#define RETRY_CLIENT_HPP
+
+namespace crypto {
+
+struct RetryPolicy {
+  using duration = std::chrono::milliseconds;
+
+  // attempts of one call, the first one included
+  int maxAttempts = 5;
+  duration baseDelay = std::chrono::milliseconds(200);
+  duration maxDelay = std::chrono::seconds(8);
+  // Budget is shared by all endpoints: every retryable failure takes a
+  // token, every success returns tokenRatio of it. Retries are made only
+  // while more than a half of maxTokens is left, so a long outage turns into
+  // single attempts instead of a retry storm. Requests not sent at all, as by
+  // an open breaker, are not charged.
+  double maxTokens = 10;
+  double tokenRatio = 0.1;
+};
+
+// Errors worth retrying: transport failures, timeouts, throttling and
+// server-side failures. Other client errors are fatal, as a retry returns
+// the same, and so are a passed deadline and an open circuit breaker. A
+// malformed response is not retried either: the server may have acted on the
+// request already.
+bool Retryable(const model::Err &err);
+
+// RetryClient retries failed requests of the wrapped client with exponential
+// backoff and full jitter. Backoff grows separately for every endpoint, so
+// failing answer submission doesn't slow down task fetching.
+class RetryClient final : public Client {
+private:
+  // Backoff of one endpoint, grows with consecutive failures
+  struct Backoff {
+    int failures = 0;
+  };
+
+  std::unique_ptr<Client> client;
+  // asynchronous requests wait out the backoff on its timers
+  boost::asio::io_context &ioc;
+  const RetryPolicy policy;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  double tokens;
+  bool stopped = false;
+  std::mt19937 random;
+  Backoff registerBackoff;
+  Backoff taskBackoff;
+  Backoff answerBackoff;
+  // backoff timers of asynchronous requests, cancelled by Stop
+  std::set<std::shared_ptr<boost::asio::steady_timer>> timers;
+
+public:
+  RetryClient(std::unique_ptr<Client> _client, boost::asio::io_context &_ioc,
+              RetryPolicy _policy = RetryPolicy{});
+  ~RetryClient() final = default;
+
+  // Makes pending and further calls return the last error without retries.
+  // NOTE: io_context must be running, so cancelled timers are handled
+  void Stop();
+
+private:
+  template <class T, class F>
+  std::variant<model::Err, T> retry(std::string_view endpoint,
+                                    Backoff &backoff, Deadline deadline,
+                                    F &&call);
+  template <class T>
+  void asyncRetry(std::string_view endpoint, Backoff &backoff,
+                  Deadline deadline, std::function<void(Handler<T>)> call,
+                  Handler<T> handler, int attempt);
+  // Returns delay before the next attempt, or nullopt if it shouldn't be made,
+  // next attempt is never started past the deadline
+  std::optional<RetryPolicy::duration> onFailure(Backoff &backoff, int attempt,
+                                                 const model::Err &err,
+                                                 Deadline deadline);
+  void onSuccess(Backoff &backoff);
+  // Returns false if interrupted by Stop
+  bool sleep(RetryPolicy::duration delay);
+
+  model::RegisterResponse doRegister(Deadline deadline) final;
+  model::TaskResponse doGetTask(Deadline deadline) final;
+  model::SendAnswerResponse doSendAnswer(const model::Answer &answer,
+                                         Deadline deadline) final;
+
+  void doAsyncRegister(Deadline deadline,
+                       Handler<model::UserInfo> handler) final;
+  void doAsyncGetTask(Deadline deadline, Handler<model::Task> handler) final;
+  void doAsyncSendAnswer(const model::Answer &answer, Deadline deadline,
+                         Handler<model::AnswerStatus> handler) final;
+
+  // task channel is not retried, subscriber reconnects it on its own
+  model::Err doSubscribe(const TaskCallback &onTask) final;
+  void doUnsubscribe() final;
+};
+
+} // namespace crypto
+
+#endif
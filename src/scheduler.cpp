@@ -0,0 +1,87 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <optional>
+
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+RoundScheduler::RoundScheduler(long long _maxIterations)
+    : maxIterations(_maxIterations),
+      latency(static_cast<double>(initialLatency.count())) {}
+
+void RoundScheduler::RecordSubmit(duration took) {
+  std::lock_guard<std::mutex> lock(mutex);
+  latency = alpha * static_cast<double>(took.count()) + (1 - alpha) * latency;
+  spdlog::debug("Submit took {}ms, average {}ms", took.count(),
+                static_cast<long>(latency));
+}
+
+void RoundScheduler::RecordRate(int gpu, double hashesPerSecond) {
+  if (hashesPerSecond <= 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = rates.find(gpu);
+  if (it == rates.end()) {
+    rates[gpu] = hashesPerSecond;
+    return;
+  }
+  it->second = alpha * hashesPerSecond + (1 - alpha) * it->second;
+}
+
+RoundScheduler::duration RoundScheduler::Reserve() {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto reserve = duration(static_cast<long>(latency * reserveFactor));
+  return std::clamp(reserve, minReserve, maxReserve);
+}
+
+RoundScheduler::clock::time_point
+RoundScheduler::Deadline(const model::Task &task) {
+  return task.expires.GetChrono() - Reserve();
+}
+
+long long RoundScheduler::Iterations(clock::time_point deadline,
+                                     const std::vector<int> &gpu) {
+  using std::chrono::duration_cast;
+  using seconds = std::chrono::duration<double>;
+
+  double rate = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // iterations are common for all lane GPUs, fastest one should not be
+    // stopped early, slower ones are stopped by the deadline
+    for (auto id : gpu) {
+      auto it = rates.find(id);
+      if (it != rates.end()) {
+        rate = std::max(rate, it->second);
+      }
+    }
+  }
+  if (rate <= 0) {
+    return maxIterations;
+  }
+
+  auto left = duration_cast<seconds>(deadline - clock::now()).count();
+  auto iterations = static_cast<long long>(rate * std::max(left, 1.0));
+  return std::clamp(iterations, 1LL, maxIterations);
+}
+
+std::optional<model::MinerTask>
+RoundScheduler::Schedule(const model::Task &task, const std::vector<int> &gpu) {
+  auto deadline = Deadline(task);
+  if (deadline <= clock::now()) {
+    spdlog::info("No time left to mine task expiring at {}",
+                 task.expires.GetUnix());
+    return std::nullopt;
+  }
+
+  model::MinerTask res(Iterations(deadline, gpu), task, gpu);
+  res.deadline = deadline;
+  return res;
+}
+
+} // namespace crypto
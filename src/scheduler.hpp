@@ -0,0 +1,60 @@
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "models.hpp"
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+namespace crypto {
+
+// RoundScheduler decides how long miners may work on a task. Answer found
+// right before expiration is useless, as it reaches server too late, so
+// mining is stopped at expires minus the reserve for submission, measured from
+// real submit latencies. Miner iterations are sized from the remaining time
+// and measured hash rate, so miners don't work past the deadline.
+class RoundScheduler {
+public:
+  using clock = std::chrono::system_clock;
+  using duration = std::chrono::milliseconds;
+
+private:
+  // reserve is a multiple of the average submit latency, but it is never less
+  // than minReserve: there are also clock skew and miner shutdown
+  static constexpr duration minReserve = std::chrono::seconds(2);
+  static constexpr duration maxReserve = std::chrono::seconds(60);
+  static constexpr duration initialLatency = std::chrono::seconds(2);
+  static constexpr double reserveFactor = 2.0;
+  // weight of the new sample in exponential moving averages
+  static constexpr double alpha = 0.2;
+
+  const long long maxIterations;
+
+  std::mutex mutex;
+  double latency;
+  // hashes per second by GPU
+  std::map<int, double> rates;
+
+public:
+  explicit RoundScheduler(long long _maxIterations);
+
+  void RecordSubmit(duration took);
+  void RecordRate(int gpu, double hashesPerSecond);
+
+  duration Reserve();
+  // Returns time point when mining of the task should be stopped
+  clock::time_point Deadline(const model::Task &task);
+  // Returns iterations enough for the gpus to work until the deadline
+  long long Iterations(clock::time_point deadline,
+                       const std::vector<int> &gpu);
+  // Prepares miner task, returns nullopt if there is no time left to mine it
+  std::optional<model::MinerTask> Schedule(const model::Task &task,
+                                           const std::vector<int> &gpu);
+};
+
+} // namespace crypto
+
+#endif
@@ -0,0 +1,155 @@
+#include "submitter.hpp"
+
+#include <chrono>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <variant>
+
+#include "retryClient.hpp"
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+AnswerSubmitter::AnswerSubmitter(Client &_client, AnswerJournal *_journal,
+                                 RoundScheduler &_scheduler)
+    : client(_client), journal(_journal), scheduler(_scheduler) {}
+
+AnswerSubmitter::~AnswerSubmitter() { Stop(); }
+
+void AnswerSubmitter::sent(AnswerJournal::Entry &entry,
+                           const model::SendAnswerResponse &resp) {
+  std::visit(model::util::overload{
+                 [this, &entry](const model::Err &err) {
+                   spdlog::error("Cant send answer: {}", err);
+                   // server may be back before the task expires, otherwise
+                   // answer stays unacknowledged in journal and is replayed
+                   // on restart
+                   if (Retryable(err) || err.code == model::Err::circuitOpen) {
+                     hold(std::move(entry));
+                   }
+                 },
+                 [this, &entry](const model::AnswerStatus &status) {
+                   spdlog::info("Result: {}", status);
+                   if (journal != nullptr) {
+                     journal->Ack(entry.key);
+                   }
+                 }},
+             resp);
+}
+
+void AnswerSubmitter::hold(AnswerJournal::Entry entry) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (stopped) {
+    return;
+  }
+  if (held.size() >= heldCapacity) {
+    spdlog::warn("Too many answers held, the oldest one dropped");
+    held.erase(held.begin());
+  }
+  spdlog::info("Answer held until the server is reachable");
+  held.push_back(std::move(entry));
+}
+
+void AnswerSubmitter::enqueue(AnswerJournal::Entry entry) {
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  using std::chrono::steady_clock;
+
+  spdlog::debug("Sending answer");
+  auto start = steady_clock::now();
+  auto answer = entry.answer;
+  client.AsyncSendAnswer(
+      answer, [this, entry = std::move(entry),
+               start](model::SendAnswerResponse resp) mutable {
+        // failed requests are also counted: reserve must cover them as well
+        scheduler.RecordSubmit(
+            duration_cast<milliseconds>(steady_clock::now() - start));
+        sent(entry, resp);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          queued--;
+        }
+        cond.notify_all();
+      });
+}
+
+bool AnswerSubmitter::Submit(model::Answer answer) {
+  AnswerJournal::Entry entry;
+  if (journal != nullptr) {
+    entry.key = journal->Record(answer);
+  }
+  entry.answer = std::move(answer);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopped) {
+      spdlog::warn("Answer submitter is stopped, answer dropped");
+      return false;
+    }
+    if (queued >= capacity) {
+      spdlog::error("Answer queue is full, answer dropped");
+      return false;
+    }
+    queued++;
+  }
+  enqueue(std::move(entry));
+  return true;
+}
+
+void AnswerSubmitter::Replay(std::vector<AnswerJournal::Entry> entries) {
+  for (auto &entry : entries) {
+    spdlog::info("Replaying journaled answer {}", entry.key);
+    // there are no miners yet, so we can wait for the queue to free up
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this]() { return stopped || queued < capacity; });
+    if (stopped) {
+      spdlog::warn("Answer submitter is stopped, replay stopped");
+      return;
+    }
+    queued++;
+    lock.unlock();
+    enqueue(std::move(entry));
+  }
+}
+
+void AnswerSubmitter::Resend() {
+  std::vector<AnswerJournal::Entry> entries;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (held.empty()) {
+      return;
+    }
+    entries.swap(held);
+  }
+
+  auto now = std::time(nullptr);
+  for (auto &entry : entries) {
+    if (entry.answer.expires.GetUnix() <= now) {
+      spdlog::warn("Held answer {} expired, dropped", entry.key);
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      // the rest stays held until the next call
+      if (stopped || queued >= capacity) {
+        held.push_back(std::move(entry));
+        continue;
+      }
+      queued++;
+    }
+    spdlog::info("Resending held answer {}", entry.key);
+    enqueue(std::move(entry));
+  }
+}
+
+void AnswerSubmitter::Stop() {
+  std::unique_lock<std::mutex> lock(mutex);
+  stopped = true;
+  cond.notify_all();
+  cond.wait(lock, [this]() { return queued == 0; });
+  spdlog::debug("Answer submitter stopped");
+}
+
+} // namespace crypto
@@ -0,0 +1,71 @@
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "client.hpp"
+#include "journal.hpp"
+#include "models.hpp"
+#include "scheduler.hpp"
+
+#ifndef SUBMITTER_HPP
+#define SUBMITTER_HPP
+
+namespace crypto {
+
+// AnswerSubmitter sends found answers to the server asynchronously, so mining
+// loop doesn't wait for the server response before taking a new task.
+// Several answers may be in flight at once, as many as client connections.
+// Answers failed because the server was unreachable are held until Resend,
+// the ones expired meanwhile are dropped.
+class AnswerSubmitter {
+private:
+  static constexpr std::size_t capacity = 16;
+  // held answers above it push the oldest ones out
+  static constexpr std::size_t heldCapacity = 64;
+
+  Client &client;
+  // journal may be null, then answers are kept only in memory
+  AnswerJournal *journal;
+  RoundScheduler &scheduler;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::size_t queued = 0;
+  bool stopped = false;
+  std::vector<AnswerJournal::Entry> held;
+
+public:
+  AnswerSubmitter(Client &_client, AnswerJournal *_journal,
+                  RoundScheduler &_scheduler);
+  ~AnswerSubmitter();
+
+  AnswerSubmitter(AnswerSubmitter &) = delete;
+  AnswerSubmitter(AnswerSubmitter &&) = delete;
+
+  AnswerSubmitter &operator=(AnswerSubmitter &) = delete;
+  AnswerSubmitter &operator=(AnswerSubmitter &&) = delete;
+
+private:
+  void enqueue(AnswerJournal::Entry entry);
+  void sent(AnswerJournal::Entry &entry,
+            const model::SendAnswerResponse &resp);
+  void hold(AnswerJournal::Entry entry);
+
+public:
+  // Journals and enqueues answer, returns false if queue is full or closed
+  bool Submit(model::Answer answer);
+  // Enqueues answers recovered from the journal
+  void Replay(std::vector<AnswerJournal::Entry> entries);
+  // Enqueues held answers which are not expired yet, call it when the server
+  // is reachable again
+  void Resend();
+  // Waits for already queued answers to be sent and stops accepting new ones.
+  // NOTE: reactor must be running, as client may wait out retries on it
+  void Stop();
+};
+
+} // namespace crypto
+
+#endif
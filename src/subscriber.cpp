@@ -0,0 +1,58 @@
+#include "subscriber.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+TaskSubscriber::TaskSubscriber(Client &_client, Client::TaskCallback _onTask)
+    : client(_client), onTask(std::move(_onTask)) {
+  thread = std::thread([this]() { run(); });
+}
+
+TaskSubscriber::~TaskSubscriber() { Stop(); }
+
+void TaskSubscriber::run() {
+  using clock = std::chrono::steady_clock;
+
+  auto backoff = minBackoff;
+  while (true) {
+    auto opened = clock::now();
+    auto err = client.Subscribe(onTask);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (stopped) {
+      return;
+    }
+    if (err.code == 404 || err.code == 501) {
+      spdlog::warn("Server has no task channel, relying on polling");
+      return;
+    }
+    // channel was fine for a while, so it is a new failure
+    if (clock::now() - opened > maxBackoff) {
+      backoff = minBackoff;
+    }
+    spdlog::warn("Task channel closed: {}, reopening in {}s", err,
+                 backoff.count());
+    if (cond.wait_for(lock, backoff, [this]() { return stopped; })) {
+      return;
+    }
+    backoff = std::min(backoff * 2, maxBackoff);
+  }
+}
+
+void TaskSubscriber::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  cond.notify_all();
+  client.Unsubscribe();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+} // namespace crypto
@@ -0,0 +1,49 @@
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "client.hpp"
+#include "models.hpp"
+
+#ifndef SUBSCRIBER_HPP
+#define SUBSCRIBER_HPP
+
+namespace crypto {
+
+// TaskSubscriber keeps the task channel to the server open, so new tasks and
+// seed rotations are known the moment they happen instead of the next poll.
+// Broken channel is reopened with exponential backoff. If server has no task
+// channel at all, subscriber gives up and polling is the only source.
+class TaskSubscriber {
+private:
+  static constexpr std::chrono::seconds minBackoff{1};
+  static constexpr std::chrono::seconds maxBackoff{60};
+
+  Client &client;
+  Client::TaskCallback onTask;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool stopped = false;
+  std::thread thread;
+
+  void run();
+
+public:
+  TaskSubscriber(Client &_client, Client::TaskCallback _onTask);
+  ~TaskSubscriber();
+
+  TaskSubscriber(TaskSubscriber &) = delete;
+  TaskSubscriber(TaskSubscriber &&) = delete;
+
+  TaskSubscriber &operator=(TaskSubscriber &) = delete;
+  TaskSubscriber &operator=(TaskSubscriber &&) = delete;
+
+  // Closes the channel and waits for the subscriber thread
+  void Stop();
+};
+
+} // namespace crypto
+
+#endif
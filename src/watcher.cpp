@@ -0,0 +1,111 @@
+#include "watcher.hpp"
+
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "boost/asio/error.hpp"
+#include "boost/system/error_code.hpp"
+#include "nlohmann/json.hpp"
+#include "spdlog/spdlog.h"
+
+namespace crypto {
+
+ConfigWatcher::ConfigWatcher(Reactor &reactor, boost::filesystem::path _path,
+                             Callback _onReload)
+    : path(std::move(_path)), onReload(std::move(_onReload)),
+      timer(reactor.Get()) {
+  std::lock_guard<std::mutex> lock(mutex);
+  boost::system::error_code ec;
+  lastWrite = boost::filesystem::last_write_time(path, ec);
+  schedule();
+}
+
+ConfigWatcher::~ConfigWatcher() { Stop(); }
+
+std::optional<model::Reloadable>
+ConfigWatcher::Load(const boost::filesystem::path &path) {
+  try {
+    std::ifstream in(path.c_str());
+    if (!in) {
+      spdlog::error("Can`t open config {}", path.string());
+      return std::nullopt;
+    }
+    auto j = nlohmann::json::parse(in);
+
+    model::Reloadable res;
+    if (j.contains("boost-factor")) {
+      res.boostFactor = j.at("boost-factor").get<long>();
+    }
+    if (j.contains("miner")) {
+      res.miner = boost::filesystem::path(j.at("miner").get<std::string>());
+    }
+    if (j.contains("gpu-range")) {
+      std::vector<int> gpu;
+      auto report = model::ParseGPU(gpu, j.at("gpu-range").get<std::string>());
+      if (!report.empty()) {
+        spdlog::error("Config gpu range parsing error: {}", report);
+        return std::nullopt;
+      }
+      res.gpu = std::move(gpu);
+    }
+    return res;
+  } catch (std::exception &e) {
+    spdlog::error("Can`t parse config {}: {}", path.string(), e.what());
+    return std::nullopt;
+  }
+}
+
+void ConfigWatcher::schedule() {
+  timer.expires_after(checkInterval);
+  timer.async_wait([this](const boost::system::error_code &ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+      return;
+    }
+    Check(false);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!stopped) {
+      schedule();
+    }
+  });
+}
+
+void ConfigWatcher::Check(bool force) {
+  // the lock also serializes reloads from the timer and SIGHUP
+  std::lock_guard<std::mutex> lock(mutex);
+  if (stopped) {
+    return;
+  }
+
+  boost::system::error_code ec;
+  auto write = boost::filesystem::last_write_time(path, ec);
+  if (ec) {
+    if (force) {
+      spdlog::error("Can`t reload config {}: {}", path.string(), ec.message());
+    }
+    return;
+  }
+  if (!force && write == lastWrite) {
+    return;
+  }
+  lastWrite = write;
+
+  auto reloaded = Load(path);
+  if (!reloaded) {
+    spdlog::warn("Config is not reloaded, keeping current settings");
+    return;
+  }
+  spdlog::info("Config reloaded: {}", Dump(reloaded.value()));
+  onReload(reloaded.value());
+}
+
+void ConfigWatcher::Stop() {
+  std::lock_guard<std::mutex> lock(mutex);
+  stopped = true;
+  timer.cancel();
+}
+
+} // namespace crypto
@@ -0,0 +1,63 @@
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <mutex>
+#include <optional>
+
+#include "boost/asio/steady_timer.hpp"
+#include "boost/filesystem.hpp"
+
+#include "models.hpp"
+#include "reactor.hpp"
+
+#ifndef WATCHER_HPP
+#define WATCHER_HPP
+
+namespace crypto {
+
+// ConfigWatcher reloads json config file when it is changed or on demand (on
+// SIGHUP). File keys are the long command line options names:
+//
+// {"boost-factor": 64, "gpu-range": "[0-3]", "miner": "/opt/pow-miner-cuda"}
+class ConfigWatcher {
+public:
+  using Callback = std::function<void(const model::Reloadable &)>;
+
+private:
+  static constexpr auto checkInterval = std::chrono::seconds(5);
+
+  const boost::filesystem::path path;
+  Callback onReload;
+
+  std::mutex mutex;
+  std::time_t lastWrite = 0;
+  bool stopped = false;
+  boost::asio::steady_timer timer;
+
+public:
+  ConfigWatcher(Reactor &reactor, boost::filesystem::path _path,
+                Callback _onReload);
+  ~ConfigWatcher();
+
+  ConfigWatcher(ConfigWatcher &) = delete;
+  ConfigWatcher(ConfigWatcher &&) = delete;
+
+  ConfigWatcher &operator=(ConfigWatcher &) = delete;
+  ConfigWatcher &operator=(ConfigWatcher &&) = delete;
+
+private:
+  void schedule();
+
+public:
+  // Parses config file, returns nullopt and logs the reason if it is invalid
+  static std::optional<model::Reloadable>
+  Load(const boost::filesystem::path &path);
+
+  // Reloads config if it is changed since the last load, or anyway if forced
+  void Check(bool force);
+  void Stop();
+};
+
+} // namespace crypto
+
+#endif
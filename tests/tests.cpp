@@ -1,8 +1,708 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "httplib.h"
+#include "openssl/evp.h"
+#include "openssl/pem.h"
+#include "openssl/x509v3.h"
+
+#include "boost/asio/io_context.hpp"
+#include "boost/filesystem.hpp"
+#include "fmt/core.h"
+#include "nlohmann/json.hpp"
+
+#include "breakerClient.hpp"
+#include "decoder.hpp"
+#include "httpClient.hpp"
+#include "journal.hpp"
+#include "mockClient.hpp"
+#include "models.hpp"
+#include "reactor.hpp"
+#include "retryClient.hpp"
+
 // This tests the output of the `get_nth_prime` function
 TEST_CASE("JSON conversions") {
     
 }
 
+namespace {
+std::string taskJSON(const std::string &seed) {
+  return fmt::format("{{\"seed\": \"{}\", \"complexity\": \"1\", "
+                     "\"giver_address\": \"giver\", \"pool_address\": "
+                     "\"pool\", \"expires\": 4102444800}}",
+                     seed);
+}
+
+std::string taskEvent(const std::string &seed) {
+  return "data: " + taskJSON(seed) + "\n\n";
+}
+
+// Self-signed certificate of localhost for TLS stand-ins of the server
+struct Certificate {
+  EVP_PKEY *key = nullptr;
+  X509 *cert = nullptr;
+
+  Certificate() {
+    auto *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY_keygen_init(ctx);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(ctx, &key);
+    EVP_PKEY_CTX_free(ctx);
+
+    cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 60 * 60);
+    X509_set_pubkey(cert, key);
+    auto *name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(
+        name, "CN", MBSTRING_ASC,
+        reinterpret_cast<const unsigned char *>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509V3_CTX v3;
+    X509V3_set_ctx_nodb(&v3);
+    X509V3_set_ctx(&v3, cert, cert, nullptr, nullptr, 0);
+    auto *san = X509V3_EXT_conf_nid(nullptr, &v3, NID_subject_alt_name,
+                                    "DNS:localhost");
+    X509_add_ext(cert, san, -1);
+    X509_EXTENSION_free(san);
+    X509_sign(cert, key, EVP_sha256());
+  }
+  ~Certificate() {
+    X509_free(cert);
+    EVP_PKEY_free(key);
+  }
+
+  Certificate(Certificate &) = delete;
+  Certificate &operator=(Certificate &) = delete;
+
+  // Saves certificate as PEM, so a client could trust it
+  void Save(const boost::filesystem::path &path) const {
+    auto *file = std::fopen(path.c_str(), "w");
+    REQUIRE(file != nullptr);
+    PEM_write_X509(file, cert);
+    std::fclose(file);
+  }
+};
+} // namespace
+
+TEST_CASE("Tasks are pushed over the task channel") {
+  // stand-in of the pool server streaming server-sent events
+  httplib::Server server;
+  std::atomic_bool done = false;
+  std::string token;
+  server.Get("/api/v1/task/subscribe", [&](const httplib::Request &req,
+                                           httplib::Response &res) {
+    token = req.get_param_value("auth_token");
+    res.set_chunked_content_provider(
+        "text/event-stream", [&](std::size_t offset, httplib::DataSink &sink) {
+          std::string chunk = ": heartbeat\n\n";
+          if (offset == 0) {
+            // other events and broken tasks are skipped, split event is
+            // joined
+            chunk += taskEvent("1") + "event: other\ndata: {}\n\n" +
+                     "data: not a json\n\n";
+            auto second = taskEvent("2");
+            chunk += second.substr(0, 10);
+            sink.write(chunk.data(), chunk.size());
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            chunk = second.substr(10);
+          } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+          }
+          sink.write(chunk.data(), chunk.size());
+          return !done.load();
+        });
+  });
+  auto port = server.bind_to_any_port("127.0.0.1");
+  std::thread serving([&server]() { server.listen_after_bind(); });
+
+  crypto::HTTPClient client(fmt::format("http://127.0.0.1:{}", port), "token",
+                            1);
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<crypto::model::Task> tasks;
+  crypto::model::Err closed;
+  std::thread subscribing([&]() {
+    closed = client.Subscribe([&](const crypto::model::Task &task) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(task);
+      }
+      cond.notify_all();
+    });
+  });
+
+  bool pushed = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    pushed = cond.wait_for(lock, std::chrono::seconds(5),
+                           [&tasks]() { return tasks.size() >= 2; });
+  }
+  client.Unsubscribe();
+  subscribing.join();
+  done.store(true);
+  server.stop();
+  serving.join();
+
+  CHECK(pushed);
+  REQUIRE(tasks.size() == 2);
+  CHECK(tasks[0].seed == "1");
+  CHECK(tasks[1].seed == "2");
+  CHECK(tasks[1].giver_address == "giver");
+  CHECK(token == "token");
+  CHECK(closed.msg == "unsubscribed");
+  // channel is closed for good
+  CHECK(client.Subscribe([](const crypto::model::Task &) {}).msg ==
+        "unsubscribed");
+}
+
+TEST_CASE("Missing task channel is reported") {
+  httplib::Server server;
+  auto port = server.bind_to_any_port("127.0.0.1");
+  std::thread serving([&server]() { server.listen_after_bind(); });
+
+  crypto::HTTPClient client(fmt::format("http://127.0.0.1:{}", port), "token",
+                            1);
+  auto err = client.Subscribe([](const crypto::model::Task &) {});
+  server.stop();
+  serving.join();
+
+  CHECK(err.code == 404);
+}
+
+TEST_CASE("Unchanged task is revalidated by its ETag") {
+  // stand-in of the pool server: the task stays the same, but the second
+  // response changes its tag
+  httplib::Server server;
+  std::mutex mutex;
+  std::vector<std::string> tags;
+  server.Get("/api/v1/task",
+             [&](const httplib::Request &req, httplib::Response &res) {
+               std::lock_guard<std::mutex> lock(mutex);
+               auto tag = req.get_header_value("If-None-Match");
+               tags.push_back(tag);
+               if (tags.size() == 3) {
+                 res.set_header("ETag", "\"2\"");
+                 res.set_content(taskJSON("1"), "application/json");
+               } else if (!tag.empty()) {
+                 res.status = 304;
+               } else {
+                 res.set_header("ETag", "\"1\"");
+                 res.set_content(taskJSON("1"), "application/json");
+               }
+             });
+  auto port = server.bind_to_any_port("127.0.0.1");
+  std::thread serving([&server]() { server.listen_after_bind(); });
+
+  crypto::HTTPClient client(fmt::format("http://127.0.0.1:{}", port), "token",
+                            1);
+  std::vector<crypto::model::TaskResponse> resps;
+  for (int i = 0; i < 4; i++) {
+    resps.push_back(client.TryGetTask());
+  }
+  server.stop();
+  serving.join();
+
+  // cached task is returned for 304 and for the same body under a new tag
+  for (auto &resp : resps) {
+    REQUIRE(std::holds_alternative<crypto::model::Task>(resp));
+    auto &task = std::get<crypto::model::Task>(resp);
+    CHECK(task.seed == "1");
+    CHECK(task.giver_address == "giver");
+  }
+  CHECK(tags == std::vector<std::string>{"", "\"1\"", "\"1\"", "\"2\""});
+}
+
+TEST_CASE("Responses are decoded without json document") {
+  std::string body = "{\"seed\": \"42\", \"complexity\": \"1\", \"extra\": "
+                     "{\"nested\": [1, 2]}, \"giver_address\": \"giver\", "
+                     "\"pool_address\": \"pool\", \"expires\": 4102444800}";
+
+  auto decoded = crypto::model::Decode<crypto::model::Task>(body);
+  REQUIRE(std::holds_alternative<crypto::model::Task>(decoded));
+  auto task = std::get<crypto::model::Task>(decoded);
+  auto expected = nlohmann::json::parse(body).get<crypto::model::Task>();
+  CHECK(task.seed == expected.seed);
+  CHECK(task.complexity == expected.complexity);
+  CHECK(task.giver_address == expected.giver_address);
+  CHECK(task.pool_address == expected.pool_address);
+  CHECK(task.expires.GetUnix() == expected.expires.GetUnix());
+
+  auto status = crypto::model::Decode<crypto::model::AnswerStatus>(
+      "{\"status\": \"ACCEPTED\"}");
+  REQUIRE(std::holds_alternative<crypto::model::AnswerStatus>(status));
+  CHECK(std::get<crypto::model::AnswerStatus>(status).accepted);
+
+  BENCHMARK("Task from json document") {
+    for (int i = 0; i < 10000; i++) {
+      task = nlohmann::json::parse(body).get<crypto::model::Task>();
+    }
+  }
+  BENCHMARK("Task decoded") {
+    for (int i = 0; i < 10000; i++) {
+      task = std::get<crypto::model::Task>(
+          crypto::model::Decode<crypto::model::Task>(body));
+    }
+  }
+}
+
+TEST_CASE("Malformed responses name the broken field") {
+  auto msg = [](std::string_view body) {
+    auto decoded = crypto::model::Decode<crypto::model::UserInfo>(body);
+    REQUIRE(std::holds_alternative<crypto::model::Err>(decoded));
+    return std::get<crypto::model::Err>(decoded).msg;
+  };
+
+  CHECK(msg("{\"pool_address\": \"p\", \"user_address\": \"u\", "
+            "\"shares\": \"1\"}") ==
+        "field shares: expected integer, got string");
+  CHECK(msg("{\"pool_address\": [], \"user_address\": \"u\", "
+            "\"shares\": 1}") == "field pool_address: expected string, "
+                                  "got array");
+  CHECK(msg("{\"pool_address\": \"p\", \"shares\": 1}") ==
+        "field user_address is missing");
+  CHECK(msg("[]") == "expected object, got array");
+  CHECK(msg("{\"pool_address\": \"p\",").rfind("malformed json at byte 22",
+                                               0) == 0);
+}
+
+TEST_CASE("TLS session is resumed after restart") {
+  namespace fs = boost::filesystem;
+  auto dir = fs::temp_directory_path() / fs::unique_path("sessions-%%%%%%%%");
+  fs::create_directories(dir);
+  Certificate certificate;
+  // OpenSSL default verify paths, which httplib uses, are taken from env
+  certificate.Save(dir / "ca.pem");
+  setenv("SSL_CERT_FILE", (dir / "ca.pem").c_str(), 1);
+
+  httplib::SSLServer server(certificate.cert, certificate.key);
+  server.Get("/api/v1/register",
+             [](const httplib::Request &, httplib::Response &res) {
+               res.set_content("{\"pool_address\": \"pool\", "
+                               "\"user_address\": \"user\", \"shares\": 1}",
+                               "application/json");
+             });
+  auto port = server.bind_to_any_port("127.0.0.1");
+  std::thread serving([&server]() { server.listen_after_bind(); });
+
+  // the second client is the first one restarted: it has only the session
+  // saved to the directory
+  auto url = fmt::format("https://localhost:{}", port);
+  for (bool restarted : {false, true}) {
+    crypto::HTTPClient client(url, "token", 1,
+                              crypto::model::Compression::responses, dir);
+    auto resp = client.TryRegister();
+    REQUIRE(std::holds_alternative<crypto::model::UserInfo>(resp));
+    auto timing = client.LastTiming();
+    CHECK_FALSE(timing.reused);
+    CHECK(timing.resumed == restarted);
+  }
+  server.stop();
+  serving.join();
+
+  unsetenv("SSL_CERT_FILE");
+  fs::remove_all(dir);
+}
+
+TEST_CASE("Queued answers are sent in one batch") {
+  // stand-in of the pool server, blocks the first answer until the rest are
+  // queued
+  httplib::Server server;
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool queued = false;
+  int singles = 0;
+  std::vector<std::size_t> batches;
+  server.Post("/api/v1/send_answer",
+              [&](const httplib::Request &, httplib::Response &res) {
+                std::unique_lock<std::mutex> lock(mutex);
+                singles++;
+                cond.notify_all();
+                cond.wait(lock, [&queued]() { return queued; });
+                res.set_content("{\"status\": \"ACCEPTED\"}",
+                                "application/json");
+              });
+
+  bool batching = true;
+  SECTION("server takes batches") {}
+  SECTION("server takes answers one by one") { batching = false; }
+  if (batching) {
+    server.Post("/api/v1/send_answers", [&](const httplib::Request &req,
+                                            httplib::Response &res) {
+      auto answers = nlohmann::json::parse(req.body);
+      auto statuses = nlohmann::json::array();
+      for (std::size_t i = 0; i < answers.size(); i++) {
+        statuses.push_back({{"status", "ACCEPTED"}});
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        batches.push_back(answers.size());
+      }
+      res.set_content(statuses.dump(), "application/json");
+    });
+  }
+  auto port = server.bind_to_any_port("127.0.0.1");
+  std::thread serving([&server]() { server.listen_after_bind(); });
+
+  crypto::model::Answer answer;
+  answer.boc = {1, 2, 3};
+  answer.giver_address = "giver";
+  answer.expires = crypto::model::util::Timestamp(
+      std::chrono::system_clock::now() + std::chrono::minutes(1));
+  {
+    crypto::HTTPClient client(fmt::format("http://127.0.0.1:{}", port),
+                              "token", 2);
+    std::vector<std::future<crypto::model::SendAnswerResponse>> sent;
+    sent.push_back(client.AsyncSendAnswer(answer));
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&singles]() { return singles == 1; });
+    }
+    for (int i = 0; i < 3; i++) {
+      sent.push_back(client.AsyncSendAnswer(answer));
+    }
+    // expired answer fails alone, the batch goes on without it
+    auto expired = client.AsyncSendAnswer(
+        answer, std::chrono::system_clock::now() - std::chrono::seconds(1));
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queued = true;
+    }
+    cond.notify_all();
+
+    auto late = expired.get();
+    REQUIRE(std::holds_alternative<crypto::model::Err>(late));
+    CHECK(std::get<crypto::model::Err>(late).code ==
+          crypto::model::Err::deadlineExceeded);
+    for (auto &resp : sent) {
+      auto status = resp.get();
+      REQUIRE(std::holds_alternative<crypto::model::AnswerStatus>(status));
+      CHECK(std::get<crypto::model::AnswerStatus>(status).accepted);
+    }
+  }
+  server.stop();
+  serving.join();
+
+  if (batching) {
+    CHECK(singles == 1);
+    CHECK(batches == std::vector<std::size_t>{3});
+  } else {
+    CHECK(singles == 4);
+    CHECK(batches.empty());
+  }
+}
+
+TEST_CASE("Batch rejected for an invalid answer is sent one by one") {
+  // stand-in of the pool server, which rejects answers of unknown giver and
+  // whole batches with any of them
+  httplib::Server server;
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool queued = false;
+  int singles = 0;
+  std::vector<std::size_t> batches;
+  auto invalid = [](const nlohmann::json &answer) {
+    return answer["giver_address"] != "giver";
+  };
+  server.Post("/api/v1/send_answer", [&](const httplib::Request &req,
+                                         httplib::Response &res) {
+    std::unique_lock<std::mutex> lock(mutex);
+    singles++;
+    cond.notify_all();
+    cond.wait(lock, [&queued]() { return queued; });
+    if (invalid(nlohmann::json::parse(req.body))) {
+      res.status = 400;
+      res.set_content("{\"status\": \"DECLINED\"}", "application/json");
+      return;
+    }
+    res.set_content("{\"status\": \"ACCEPTED\"}", "application/json");
+  });
+  server.Post("/api/v1/send_answers", [&](const httplib::Request &req,
+                                          httplib::Response &res) {
+    auto answers = nlohmann::json::parse(req.body);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      batches.push_back(answers.size());
+    }
+    if (std::any_of(answers.begin(), answers.end(), invalid)) {
+      res.status = 400;
+      res.set_content("{\"error\": \"invalid answer\"}", "application/json");
+      return;
+    }
+    auto statuses = nlohmann::json::array();
+    for (std::size_t i = 0; i < answers.size(); i++) {
+      statuses.push_back({{"status", "ACCEPTED"}});
+    }
+    res.set_content(statuses.dump(), "application/json");
+  });
+  auto port = server.bind_to_any_port("127.0.0.1");
+  std::thread serving([&server]() { server.listen_after_bind(); });
+
+  crypto::model::Answer answer;
+  answer.boc = {1, 2, 3};
+  answer.giver_address = "giver";
+  answer.expires = crypto::model::util::Timestamp(
+      std::chrono::system_clock::now() + std::chrono::minutes(1));
+  auto wrong = answer;
+  wrong.giver_address = "unknown";
+  {
+    crypto::HTTPClient client(fmt::format("http://127.0.0.1:{}", port),
+                              "token", 2);
+    std::vector<std::future<crypto::model::SendAnswerResponse>> sent;
+    sent.push_back(client.AsyncSendAnswer(answer));
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&singles]() { return singles == 1; });
+    }
+    sent.push_back(client.AsyncSendAnswer(answer));
+    auto rejected = client.AsyncSendAnswer(wrong);
+    sent.push_back(client.AsyncSendAnswer(answer));
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queued = true;
+    }
+    cond.notify_all();
+
+    auto declined = rejected.get();
+    REQUIRE(std::holds_alternative<crypto::model::AnswerStatus>(declined));
+    CHECK_FALSE(std::get<crypto::model::AnswerStatus>(declined).accepted);
+    for (auto &resp : sent) {
+      auto status = resp.get();
+      REQUIRE(std::holds_alternative<crypto::model::AnswerStatus>(status));
+      CHECK(std::get<crypto::model::AnswerStatus>(status).accepted);
+    }
+  }
+  server.stop();
+  serving.join();
+
+  CHECK(batches == std::vector<std::size_t>{3});
+  CHECK(singles == 4);
+}
+
+TEST_CASE("Failed requests are retried within budget and deadline") {
+  using crypto::model::Err;
+  boost::asio::io_context ioc;
+  auto mock = std::make_unique<crypto::mock::MockClient>("url", "token");
+  auto &server = *mock;
+  crypto::RetryPolicy policy;
+  policy.maxAttempts = 100;
+  policy.baseDelay = std::chrono::milliseconds(1);
+  policy.maxDelay = std::chrono::milliseconds(2);
+  crypto::RetryClient client(std::move(mock), ioc, policy);
+  const Err transport{std::nullopt, Err::transport, "connection failed"};
+
+  SECTION("transport failure is retried") {
+    server.Fail(transport, 2);
+    auto resp = client.TryGetTask();
+    CHECK(std::holds_alternative<crypto::model::Task>(resp));
+    CHECK(server.Requests() == 3);
+  }
+  SECTION("asynchronous request is retried on the reactor") {
+    server.Fail(transport, 2);
+    auto resp = client.AsyncGetTask();
+    ioc.run();
+    CHECK(std::holds_alternative<crypto::model::Task>(resp.get()));
+    CHECK(server.Requests() == 3);
+  }
+  SECTION("broken response and client errors are not retried") {
+    server.Fail(Err{"{}", -1, "field seed is missing"});
+    server.Fail(Err{std::nullopt, 404, "not found"});
+    CHECK(std::get<Err>(client.TryGetTask()).code == -1);
+    CHECK(std::get<Err>(client.TryGetTask()).code == 404);
+    CHECK(server.Requests() == 2);
+  }
+  SECTION("retries stop when budget is spent") {
+    // every failure takes a token, retries stop at a half of them
+    server.Fail(transport, 100);
+    CHECK(std::get<Err>(client.TryGetTask()).code == Err::transport);
+    CHECK(server.Requests() == 5);
+  }
+  SECTION("retry is not started past the deadline") {
+    server.Fail(transport, 2);
+    auto passed = std::chrono::system_clock::now() - std::chrono::seconds(1);
+    CHECK(std::get<Err>(client.TryGetTask(passed)).code == Err::transport);
+    CHECK(server.Requests() == 1);
+  }
+}
+
+TEST_CASE("Requests rejected by an open breaker don't drain retry budget") {
+  using crypto::BreakerClient;
+  using crypto::model::Err;
+  using std::chrono::milliseconds;
+  boost::asio::io_context ioc;
+  auto mock = std::make_unique<crypto::mock::MockClient>("url", "token");
+  auto &server = *mock;
+  crypto::BreakerPolicy breakerPolicy;
+  breakerPolicy.minOpen = milliseconds(100);
+  auto breaker =
+      std::make_unique<BreakerClient>(std::move(mock), breakerPolicy);
+  auto &state = *breaker;
+  crypto::RetryPolicy retryPolicy;
+  retryPolicy.baseDelay = milliseconds(1);
+  retryPolicy.maxDelay = milliseconds(2);
+  crypto::RetryClient client(std::move(breaker), ioc, retryPolicy);
+
+  server.Fail(Err{std::nullopt, Err::transport, "connection failed"}, 5);
+  for (int i = 0; i < 5; i++) {
+    state.TryGetTask();
+  }
+  REQUIRE(state.Current() == BreakerClient::State::open);
+  for (int i = 0; i < 50; i++) {
+    CHECK(std::get<Err>(client.TryGetTask()).code == Err::circuitOpen);
+  }
+  // neither are requests past their deadline or refused by the server
+  server.Fail(Err{std::nullopt, 404, "not found"}, 50);
+  std::this_thread::sleep_for(milliseconds(150));
+  for (int i = 0; i < 50; i++) {
+    CHECK(std::get<Err>(client.TryGetTask()).code == 404);
+  }
+  server.Fail(Err{std::nullopt, Err::deadlineExceeded, "no time left"}, 50);
+  for (int i = 0; i < 50; i++) {
+    CHECK(std::get<Err>(client.TryGetTask()).code == Err::deadlineExceeded);
+  }
+  CHECK(server.Requests() == 105);
+
+  // breaker was closed by the first 404, a single 502 is retried
+  REQUIRE(state.Current() == BreakerClient::State::closed);
+  server.Fail(Err{std::nullopt, 502, "bad gateway"});
+  CHECK(std::holds_alternative<crypto::model::Task>(client.TryGetTask()));
+  CHECK(server.Requests() == 107);
+}
+
+TEST_CASE("Circuit breaker stops requests to a failing server") {
+  using crypto::BreakerClient;
+  using crypto::model::Err;
+  using State = BreakerClient::State;
+  using std::chrono::milliseconds;
+  auto mock = std::make_unique<crypto::mock::MockClient>("url", "token");
+  auto &server = *mock;
+  crypto::BreakerPolicy policy;
+  policy.minOpen = milliseconds(100);
+  policy.maxOpen = milliseconds(1000);
+  BreakerClient breaker(std::move(mock), policy);
+  const Err transport{std::nullopt, Err::transport, "connection failed"};
+
+  // client errors are answered by a healthy server
+  server.Fail(Err{std::nullopt, 404, "not found"}, 5);
+  for (int i = 0; i < 5; i++) {
+    breaker.TryGetTask();
+  }
+  CHECK(breaker.Current() == State::closed);
+
+  server.Fail(transport, 5);
+  for (int i = 0; i < 5; i++) {
+    breaker.TryGetTask();
+  }
+  REQUIRE(breaker.Current() == State::open);
+  auto resp = breaker.TryGetTask();
+  REQUIRE(std::holds_alternative<Err>(resp));
+  CHECK(std::get<Err>(resp).code == Err::circuitOpen);
+  CHECK(server.Requests() == 10);
+
+  std::this_thread::sleep_for(milliseconds(150));
+  CHECK(breaker.Current() == State::halfOpen);
+
+  SECTION("failed probe opens it for twice as long") {
+    server.Fail(transport);
+    CHECK(std::get<Err>(breaker.TryGetTask()).code == Err::transport);
+    CHECK(breaker.Current() == State::open);
+    std::this_thread::sleep_for(milliseconds(150));
+    CHECK(breaker.Current() == State::open);
+    std::this_thread::sleep_for(milliseconds(100));
+    CHECK(breaker.Current() == State::halfOpen);
+  }
+  SECTION("single probe is let through and closes it") {
+    server.Hold();
+    auto probe = breaker.AsyncGetTask();
+    auto rejected = breaker.AsyncGetTask();
+    auto other = rejected.get();
+    REQUIRE(std::holds_alternative<Err>(other));
+    CHECK(std::get<Err>(other).code == Err::circuitOpen);
+    server.Release();
+    CHECK(std::holds_alternative<crypto::model::Task>(probe.get()));
+    CHECK(server.Requests() == 11);
+    CHECK(breaker.Current() == State::closed);
+    CHECK(std::holds_alternative<crypto::model::Task>(breaker.TryGetTask()));
+  }
+}
+
+TEST_CASE("Journal replays unacknowledged answers after compaction") {
+  namespace fs = boost::filesystem;
+  using std::chrono::system_clock;
+  auto path = fs::temp_directory_path() / fs::unique_path("journal-%%%%%%%%");
+  auto lines = [&path]() {
+    std::ifstream in(path.c_str());
+    std::string line;
+    std::size_t res = 0;
+    while (std::getline(in, line)) {
+      res++;
+    }
+    return res;
+  };
+  crypto::Reactor reactor(1);
+
+  crypto::model::Answer answer;
+  answer.boc = {1, 2, 3};
+  answer.giver_address = "giver";
+  answer.expires = crypto::model::util::Timestamp(system_clock::now() +
+                                                  std::chrono::hours(1));
+  std::vector<std::string> unacked;
+  {
+    crypto::AnswerJournal journal(reactor, path);
+    CHECK(journal.Recover().empty());
+    auto expired = answer;
+    expired.seed = "expired";
+    expired.expires = crypto::model::util::Timestamp(system_clock::now() -
+                                                     std::chrono::minutes(1));
+    journal.Record(expired);
+    for (int i = 0; i < 300; i++) {
+      answer.seed = std::to_string(i);
+      auto key = journal.Record(answer);
+      if (i % 10 == 0) {
+        unacked.push_back(key);
+      } else {
+        journal.Ack(key);
+      }
+    }
+    // acknowledged records dominate, so the flush timer compacts the journal
+    const std::size_t written = 1 + 300 + 270;
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (lines() >= written && std::chrono::steady_clock::now() < until) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(lines() < written);
+  }
+
+  {
+    crypto::AnswerJournal journal(reactor, path);
+    std::vector<std::string> recovered;
+    for (auto &entry : journal.Recover()) {
+      CHECK(entry.answer.giver_address == "giver");
+      CHECK(entry.answer.boc == answer.boc);
+      recovered.push_back(entry.key);
+    }
+    std::sort(unacked.begin(), unacked.end());
+    CHECK(recovered == unacked);
+    CHECK(lines() == unacked.size());
+  }
+  reactor.Stop();
+  fs::remove(path);
+}